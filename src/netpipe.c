@@ -27,17 +27,76 @@
 #include "mplite.h" /* Included for the malloc wrapper to protect from */
 #endif
 
-inline unsigned long long rdtsc()
-{
-  unsigned long long tsc;
-  asm volatile("rdtsc;"
-               "shl $32,%%rdx;"
-               "or %%rdx,%%rax"
-               : "=a"(tsc)
-               :
-               : "%rcx", "%rdx");
-  return tsc;
-}
+#include <sys/utsname.h>    /* uname() for the run metadata */
+
+/* Module name for the run metadata */
+#if defined(OPENIB)
+  #define NPMODULE "ibv"
+#elif defined(INFINIBAND)
+  #define NPMODULE "ib"
+#elif defined(TCP)
+  #define NPMODULE "tcp"
+#elif defined(URING)
+  #define NPMODULE "uring"
+#elif defined(TCP6)
+  #define NPMODULE "tcp6"
+#elif defined(SCTP6)
+  #define NPMODULE "sctp6"
+#elif defined(SCTP)
+  #define NPMODULE "sctp"
+#elif defined(IPX)
+  #define NPMODULE "ipx"
+#elif defined(MPI2)
+  #define NPMODULE "mpi2"
+#elif defined(MPI)
+  #define NPMODULE "mpi"
+#elif defined(PVM)
+  #define NPMODULE "pvm"
+#elif defined(TCGMSG)
+  #define NPMODULE "tcgmsg"
+#elif defined(LAPI)
+  #define NPMODULE "lapi"
+#elif defined(GPSHMEM)
+  #define NPMODULE "gpshmem"
+#elif defined(SHMEM)
+  #define NPMODULE "shmem"
+#elif defined(ARMCI)
+  #define NPMODULE "armci"
+#elif defined(GM)
+  #define NPMODULE "gm"
+#elif defined(ATOLL)
+  #define NPMODULE "atoll"
+#elif defined(MEMCPY)
+  #define NPMODULE "memcpy"
+#elif defined(DISK)
+  #define NPMODULE "disk"
+#else
+  #define NPMODULE "unknown"
+#endif
+
+/* Names of the exchanged metrics, as written in structured output */
+static char *metric_names[NMETRICS] = {
+    "time_ns", "median_ns", "trials", "p50_ns", "p99_ns", "max_ns",
+    "work_start", "work_end", "work_ns", "pkg0_uj", "pkg1_uj",
+    "user_ns", "sys_ns", "msgs", "syscalls"
+};
+
+/* Sysctls that most often explain differences between runs */
+static char *sysctl_names[NSYSCTL] = {
+    "net.core.rmem_max",
+    "net.core.wmem_max",
+    "net.ipv4.tcp_rmem",
+    "net.ipv4.tcp_wmem",
+    "net.ipv4.tcp_congestion_control",
+    "net.ipv4.tcp_autocorking",
+    "net.core.busy_poll",
+    "net.core.busy_read",
+    "net.core.netdev_max_backlog",
+    "kernel.numa_balancing"
+};
+
+/* Names of the receive modes of -J, as written in structured output */
+static char *rx_names[] = { "block", "spin", "busy", "hybrid", "adaptive" };
 
 unsigned long long work_start;
 unsigned long long work_end;
@@ -54,13 +113,13 @@ int main(int argc, char **argv)
     char        s[255],s2[255],delim[255],*pstr; /* Generic strings          */
     int         *memcache;      /* used to flush cache                       */
 
-    int         len_buf_align,  /* meaningful when args.cache is 0. buflen   */
+    int         len_buf_align=0,/* meaningful when args.cache is 0. buflen   */
                                 /* rounded up to be divisible by 8           */
                 num_buf_align;  /* meaningful when args.cache is 0. number   */
                                 /* of aligned buffers in memtmp              */
 
     int         c,              /* option index                              */
-                i, j, n, nq,    /* Loop indices                              */
+                i=0, j, k, n, nq,/* Loop indices                            */
                 asyncReceive=0, /* Pre-post a receive buffer?                */
                 bufalign=16*1024,/* Boundary to align buffer to              */
                 errFlag,        /* Error occurred in inner testing loop      */
@@ -70,23 +129,118 @@ int main(int argc, char **argv)
                 inc=0,          /* Increment value                           */
                 perturbation=DEFPERT, /* Perturbation value                  */
                 pert,
+                llast,          /* Message size of the last transmission     */
+                done=0,         /* Set when the transmitter ends the curve   */
+                rapl_ok=0,      /* RAPL energy counters are readable         */
                 start= 1,       /* Starting value for signature curve        */
                 end=MAXINT,     /* Ending value for signature curve          */
                 streamopt=0,    /* Streaming mode flag                       */
                 reset_connection,/* Reset the connection between trials      */
+                timer=TIMER_MONO,/* Timer backend used by When()             */
+                daemonopt=0,    /* Receiver serves one session after another */
+                sessions=0,     /* Sessions served so far                    */
+                loops=1,        /* Times to measure the whole curve          */
+                loop,           /* Current loop                              */
+                npts=0,         /* Points per loop kept for the summary      */
+                ack,            /* Messages acknowledged by the receiver     */
+                inflight=0,     /* Messages kept in flight in rate mode      */
+                nflight=0,      /* ... for the current message size          */
+                sent,           /* Messages sent so far in a trial           */
+                poisson=0,      /* Poisson arrivals in open-loop mode        */
+                response=0,     /* Response size, 0 to echo the request      */
+                service_exp=0,  /* Exponential service times                 */
+                rpc,            /* Response size or service time are set     */
+                ntrace=0,       /* Records in the replayed trace             */
+                tracemax=0,     /* Largest record of the trace               */
+                ndist=0,        /* Sizes in the message size table           */
+                distmax=0,      /* Largest size of the table                 */
+                dist_seed=1,    /* Seed the table was drawn with             */
+                *dsize=NULL,    /* Message size of each iteration            */
+                nstreams=0,     /* Concurrent streams, 0 for the usual one   */
+                pin=0,          /* Pin the stream threads to cores           */
+                incast=0,       /* The streams are incast senders            */
+                nfan=0,         /* Receivers fanned out to after the first   */
 		debug_wait=0;	/* spin and wait for a debugger		     */
    
     ArgStruct   args;           /* Arguments for all the calls               */
 
     double      t, t0, t1, t2,  /* Time variables                            */
                 tlast,          /* Time for the last transmission            */
+                tlast0,         /* ... and for the first, before any loop    */
+                *loop_t=NULL,   /* Time of each point in each loop           */
+                orate=0.0,      /* First offered load in open-loop mode      */
+                orate_cur=0.0,  /* ... and that of the current point         */
+                service=0.0,    /* Receiver service time per request         */
+                *rec_lat=NULL,  /* Latency of each trace record in a trial   */
+                *rec_sum=NULL,  /* ... summed over the kept trials           */
+                tracebytes=0.0, /* Bytes in the whole trace                  */
+                distmean=0.0,   /* Mean size of the message size table       */
+                *stream_t=NULL, /* Time each stream took in a trial          */
+                *stream_bps=NULL,/* ... and its rate in the fastest trial    */
+                ssum, ssq,      /* Sums of the streams' rates and squares    */
+                *stream_comp=NULL,/* Mean completion of each incast sender   */
+                *lat_round=NULL,/* Time of each incast round of a trial      */
+                tbusy=0.0,      /* Receiver's time in incast rounds          */
                 latency,        /* Network message latency                   */
                 tstart, tend;
+
+    TraceRec    *trace=NULL;    /* Replayed trace                            */
+    char        tracefile[255]; /* ... and the file it came from             */
+    Hist        *sizehist=NULL; /* Latencies per power-of-2 size bucket      */
+    Hist        *fanhist=NULL;  /* Reply latencies of each receiver          */
+#if defined(MULTISTREAM)
+    ArgStruct   *st=NULL;       /* Connections of the concurrent streams     */
+#endif
+#if defined(FANOUT)
+    char        *fanhost[MAXFAN];/* Receivers to fan out to after the first  */
+    int         fanport[MAXFAN];/* ... and their ports                      */
+    Metrics     mfan;           /* Measurements of those receivers           */
+#endif
+#if defined(BULKLOAD)
+    BulkLoad    *bulk=NULL;     /* Bulk connection of the current curve      */
+    double      bulk0=0.0;      /* Bulk bytes moved before the point         */
+#endif
+#if defined(ZEROCOPY)
+    unsigned int zc0_sent=0,    /* Zero-copy sends before the point          */
+                zc0_copied=0;   /* ... and those the kernel copied           */
+#endif
+#if defined(ZC_RECV)
+    unsigned long long zc0_rbytes=0, /* Bytes received by -Z r before it,    */
+                zc0_mapped=0;   /* ... and those mapped                      */
+#endif
     
     Data        bwdata[NSAMP];  /* Bandwidth curve data                      */
 
     int         integCheck=0;   /* Integrity check                           */
 
+    int         format=OUT_PLAIN;/* Output file format                       */
+    RunInfo     runinfo;        /* Configuration and host identification     */
+    Pass        pass;           /* Current curve of the run, and the last    */
+    Metrics     mlocal, mremote;/* Both sides' measurements of a point       */
+    struct rusage ru0, ru1;     /* CPU time used by a point                  */
+    long long   sys0 = 0;       /* ... and the module's system call count    */
+    long long   rxc0 = 0, rxb0 = 0;/* ... and receives and blocks under -J     */
+
+    int         histopt=0;      /* Record a latency histogram per point      */
+    Hist        lathist;        /* Per-iteration latencies of current point  */
+    double      tj;             /* Start time of the current iteration       */
+
+    int         trials=TRIALS,  /* Number of trials, or the most if adaptive */
+                trials_set=0,   /* Set if -N gave the number of trials       */
+                discard=0,      /* Leading warmup trials left out of results */
+                more;           /* Set while the transmitter wants a trial   */
+    double      runtm=RUNTM,    /* Target run time of a trial                */
+                precision=0.0,  /* Stop once the median CI is within this %  */
+                budget=0.0,     /* Time budget for each data point           */
+                trial_t[MAXTRIALS]; /* Times of the trials of one point      */
+
+    int         warmup_n=0,     /* Untimed warmup iterations per point       */
+                wblk,           /* Iterations in the current warmup block    */
+                wdone;          /* Total warmup iterations done so far       */
+    double      warmup_t=0.0,   /* ... or warmup duration in seconds         */
+                warmup_pct=0.0, /* Warm up until block times agree within %  */
+                wlast;          /* Iteration time of the last warmup block   */
+
     work_start = 0;
     work_end = 0;    
     pk0_joules = 0.0;
@@ -97,11 +251,18 @@ int main(int argc, char **argv)
     /* Initialize vars that may change from default due to arguments */
 
     strcpy(s, "np.out");   /* Default output file */
+    memset(&pass, 0, sizeof(pass));   /* No extra curves unless asked for */
+
+    srand48((long)time(NULL) ^ (long)getpid());  /* Vary random draws by run */
 
     /* Let modules initialize related vars, and possibly call a library init
        function that requires argc and argv */
 
     
+    args.syscalls = -1;          /* Modules that count them set it to 0 */
+    args.rxpoll = 0;             /* RecvData() blocks unless -J is given */
+    args.rxfd = -1;
+    args.rxcalls = args.rxblocks = 0;
     Init(&args, &argc, &argv);   /* This will set args.tr and args.rcv */
 
     args.preburst = 0; /* Default to not bursting preposted receives */
@@ -113,6 +274,10 @@ int main(int argc, char **argv)
     args.roffset=0; 
     args.syncflag=0; /* use normal mpi_send */
     args.use_sdp=0; /* default to no SDP */
+    args.connect_retry=0;
+    args.nfan=0;
+    args.fan=NULL;
+    args.fan_done=NULL;
     args.port = DEFPORT; /* just in case the user doesn't set this. */
 
 
@@ -124,7 +289,7 @@ int main(int argc, char **argv)
 #if ! defined(TCGMSG)
 
     /* Parse the arguments. See Usage for description */
-    while ((c = getopt(argc, argv, "AXSO:rIiPszgfaB2h:p:o:l:u:b:m:n:t:c:d:D:P:")) != -1)
+    while ((c = getopt(argc, argv, "AXSO:rKIiszgfaqB2HC:N:L:W:M:Q:y:x:j:G:T:V:U:Z:J:R:e:E:k:w:F:h:p:o:l:u:b:m:n:t:c:d:D:P:")) != -1)
     {
         switch(c)
         {
@@ -175,7 +340,7 @@ int main(int argc, char **argv)
 
             case 's': streamopt = 1;
                       printf("Streaming in one direction only.\n\n");
-#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
                       printf("Sockets are reset between trials to avoid\n");
                       printf("degradation from a collapsing window size.\n\n");
 #endif
@@ -201,7 +366,7 @@ int main(int argc, char **argv)
             case 'u': end = atoi(optarg);
                       break;
 
-#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
             case 'b': /* -b # resets the buffer size, -b 0 keeps system defs */
                       args.prot.sndbufsz = args.prot.rcvbufsz = atoi(optarg);
                       break;
@@ -211,7 +376,7 @@ int main(int argc, char **argv)
                          /* end will be maxed at sndbufsz+rcvbufsz */
                       printf("Passing data in both directions simultaneously.\n");
                       printf("Output is for the combined bandwidth.\n");
-#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
                       printf("The socket buffer size limits the maximum test size.\n\n");
 #endif
                       if( streamopt ) {
@@ -222,6 +387,20 @@ int main(int argc, char **argv)
 
             case 'h': args.tr = 1;       /* -h implies transmit node */
                       args.rcv = 0;
+#if defined(FANOUT)
+                      /* Each -h after the first adds a receiver to fan out to */
+                      if (args.host != NULL)
+                      {
+                        if (nfan == MAXFAN)
+                        {
+                          fprintf(stderr, "Can't fan out to more than %d receivers\n", MAXFAN+1);
+                          exit(-1);
+                        }
+                        fanhost[nfan++] = strdup(optarg);
+                        histopt = 1;
+                        break;
+                      }
+#endif
                       args.host = (char *)malloc(strlen(optarg)+1);
                       strcpy(args.host, optarg);
                       break;
@@ -380,11 +559,329 @@ int main(int argc, char **argv)
             case 'n': nrepeat_const = atoi(optarg);
                       break;
 
-#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
             case 'r': args.reset_conn = 1;
                       printf("Resetting connection after every trial\n");
                       break;
+
+            case 'K': daemonopt = 1;
+                      printf("Serving one session after another\n");
+                      break;
+#endif
+            case 'C': if( !strcmp(optarg, "mono") ) {
+                         timer = TIMER_MONO;
+                      } else if( !strcmp(optarg, "tsc") ) {
+                         timer = TIMER_TSC;
+                      } else {
+                         fprintf(stderr, "Invalid timer specified, please "
+                                 "choose one of:\n\n"
+                                 "\tmono\tclock_gettime(CLOCK_MONOTONIC_RAW)\t(default)\n"
+                                 "\ttsc\tInvariant cycle counter (x86 TSC, ARM cntvct)\n\n");
+                         exit(-1);
+                      }
+                      break;
+
+            case 'N': trials = atoi(optarg);
+                      trials_set = 1;
+                      if (trials < 1 || trials > MAXTRIALS) {
+                        fprintf(stderr, "Need between 1 and %d trials\n", MAXTRIALS);
+                        exit(-1);
+                      }
+                      break;
+
+            case 'R': runtm = atof(optarg);
+                      if (runtm <= 0.0) {
+                        fprintf(stderr, "Need a run time > 0 seconds\n");
+                        exit(-1);
+                      }
+                      break;
+
+            case 'e': precision = atof(optarg);
+                      printf("Adding trials until the 95%% confidence interval of\n");
+                      printf("the median is within %g%% of the median\n\n", precision);
+                      break;
+
+            case 'E': budget = atof(optarg);
+                      printf("Spending at most %g seconds on each data point\n\n", budget);
+                      break;
+
+            case 'W': pass.winmax = atoi(optarg);
+                      if (pass.winmax < 1)
+                      {
+                        fprintf(stderr, "Need a window of at least 1 message\n");
+                        exit(-1);
+                      }
+                      if( args.bidir == 1 ) {
+                        printf("You can't use -W and -2 together\n");
+                        exit(0);
+                      }
+                      /* Data flows one way, as when streaming, but the
+                       * receiver acknowledges every window of messages.
+                       */
+                      streamopt = 1;
+                      printf("Sending windows of 1 to %d messages, each\n", pass.winmax);
+                      printf("acknowledged by the receiver.\n\n");
+                      break;
+
+#if defined(OPENLOOP)
+            case 'Q': /* -Q rate, optionally ,p for Poisson arrivals */
+                      strcpy(s2,optarg);
+                      if((pstr=strtok(s2,",")) != NULL) {
+                         orate = atof(pstr);
+                         if((pstr=strtok((char *)NULL,",")) != NULL)
+                            poisson = (pstr[0] == 'p');
+                      }
+                      if (orate <= 0.0)
+                      {
+                        fprintf(stderr, "Need an offered load above 0 requests/s\n");
+                        exit(-1);
+                      }
+                      perturbation = 0;
+                      histopt = 1;
+                      printf("Open-loop load from %g requests/s, doubling until\n", orate);
+                      printf("saturation, with %s arrivals.\n\n",
+                             poisson ? "Poisson" : "evenly spaced");
+                      break;
+#endif
+
+#if defined(MULTISTREAM)
+            case 'T': /* -T streams, optionally ,c to pin them to cores */
+                      strcpy(s2,optarg);
+                      if((pstr=strtok(s2,",")) != NULL) {
+                         nstreams = atoi(pstr);
+                         if((pstr=strtok((char *)NULL,",")) != NULL)
+                            pin = (pstr[0] == 'c');
+                      }
+                      if (nstreams < 1)
+                      {
+                        fprintf(stderr, "Need at least 1 stream\n");
+                        exit(-1);
+                      }
+                      incast = 0;
+                      printf("Running %d concurrent streams, each on its own\n", nstreams);
+                      printf("connection%s.\n\n", pin ? " and core" : "");
+                      break;
+#endif
+
+#if defined(INCAST)
+            case 'V': /* -V senders, optionally ,c to pin them to cores */
+                      strcpy(s2,optarg);
+                      if((pstr=strtok(s2,",")) != NULL) {
+                         nstreams = atoi(pstr);
+                         if((pstr=strtok((char *)NULL,",")) != NULL)
+                            pin = (pstr[0] == 'c');
+                      }
+                      if (nstreams < 1)
+                      {
+                        fprintf(stderr, "Need at least 1 sender\n");
+                        exit(-1);
+                      }
+                      incast = 1;
+                      histopt = 1;
+                      printf("Incast from 1, 2, 4 ... up to %d senders at once, each\n", nstreams);
+                      printf("on its own connection, to a receiver serving them all\n");
+                      printf("with epoll.\n\n");
+                      break;
+#endif
+
+#if defined(BULKLOAD)
+            case 'U': /* -U bulk socket buffer sizes, comma separated */
+                      strcpy(s2,optarg);
+                      for (pstr = strtok(s2,","); pstr != NULL;
+                           pstr = strtok((char *)NULL,","))
+                      {
+                        if (pass.nload == MAXLOAD)
+                        {
+                          fprintf(stderr, "Can't load with more than %d buffer sizes\n", MAXLOAD);
+                          exit(-1);
+                        }
+                        pass.loadbuf[pass.nload++] = atoi(pstr);
+                      }
+                      histopt = 1;
+                      printf("Measuring the curve idle, then with bulk data streaming\n");
+                      printf("on a second connection with socket buffers of");
+                      for (i = 0; i < pass.nload; i++)
+                        printf(" %d", pass.loadbuf[i]);
+                      printf(" bytes.\n\n");
+                      break;
+#endif
+
+#if defined(ZEROCOPY)
+            case 'Z': /* -Z s for zero-copy sends, r for receives, or sr */
+                      if (strchr(optarg, 's') != NULL)
+                        pass.zcopt |= ZC_SEND;
+#if defined(ZC_RECV)
+                      if (strchr(optarg, 'r') != NULL)
+                        pass.zcopt |= ZC_RECV;
+#endif
+                      if (!pass.zcopt)
+                      {
+                        fprintf(stderr, "Invalid zero-copy mode, please use s for sends,\n"
+                                        "r for receives or sr for both\n");
+                        exit(-1);
+                      }
+                      printf("Measuring the curve copying, then with zero-copy%s%s.\n\n",
+                             pass.zcopt & ZC_SEND ? (pass.zcopt > ZC_SEND ? " sends and" : " sends") : "",
+                             pass.zcopt > ZC_SEND ? " receives" : "");
+                      break;
+#endif
+
+#if defined(RXPOLL)
+            case 'J': /* -J receive policies, comma separated: s to spin,
+                       * b[usec] to busy poll */
+                      strcpy(s2,optarg);
+                      for (pstr = strtok(s2,","); pstr != NULL;
+                           pstr = strtok((char *)NULL,","))
+                      {
+                        if (pass.npoll == MAXPOLL)
+                        {
+                          fprintf(stderr, "Can't compare more than %d receive policies\n", MAXPOLL);
+                          exit(-1);
+                        }
+                        if (strcmp(pstr, "s") == 0)
+                          pass.rxpol[pass.npoll++] = RX_POLICY(RX_SPIN, 0);
+                        else if (isdigit((unsigned char)pstr[0]))
+                          pass.rxpol[pass.npoll++] = RX_POLICY(RX_HYBRID, atoi(pstr));
+                        else if (pstr[0] == 'a' && atoi(pstr+1) >= 0)
+                          pass.rxpol[pass.npoll++] = RX_POLICY(RX_ADAPT, pstr[1] ? atoi(pstr+1) : 100);
+#if defined(BUSYPOLL)
+                        else if (pstr[0] == 'b' && atoi(pstr+1) >= 0)
+                          pass.rxpol[pass.npoll++] = RX_POLICY(RX_BUSY, pstr[1] ? atoi(pstr+1) : 50);
+#endif
+                        else
+                        {
+                          fprintf(stderr, "Invalid receive policy %s, please use s to spin,"
+#if defined(BUSYPOLL)
+                                          "\nb[usec] to busy poll,"
+#endif
+                                          "\nusec to spin that long and block, or a[usec] to\n"
+                                          "spin adaptively up to usec and block\n", pstr);
+                          exit(-1);
+                        }
+                      }
+                      printf("Measuring the curve blocking in read(), then");
+                      for (i = 0; i < pass.npoll; i++)
+                      {
+                        printf(i ? ", " : " ");
+                        PrintPolicy(stdout, pass.rxpol[i]);
+                      }
+                      printf(".\n\n");
+                      histopt = 1;
+                      break;
+#endif
+
+#if defined(URING)
+            case 'q': args.prot.sqpoll = 1;
+                      printf("Polling for submissions and completions (SQPOLL)\n\n");
+                      break;
 #endif
+
+            case 'j': strcpy(tracefile, optarg);
+                      if ((ntrace = ReadTrace(tracefile, &trace)) < 1)
+                      {
+                        fprintf(stderr, "No messages found in trace %s\n", tracefile);
+                        exit(-1);
+                      }
+                      perturbation = 0;
+                      histopt = 1;
+                      printf("Replaying the %d messages of %s\n\n", ntrace, tracefile);
+                      break;
+
+            case 'G': /* -G distribution, optionally @seed */
+                      strcpy(s2,optarg);
+                      if ((pstr = strrchr(s2, '@')) != NULL) {
+                         *pstr = '\0';
+                         dist_seed = atoi(pstr+1);
+                      }
+                      if ((ndist = DrawSizes(s2, dist_seed, NDIST, &dsize)) < 1)
+                        exit(-1);
+                      perturbation = 0;
+                      histopt = 1;
+                      printf("Message sizes drawn from %s with seed %d\n\n",
+                             s2, dist_seed);
+                      break;
+
+            case 'y': response = atoi(optarg);
+                      if (response < 1)
+                      {
+                        fprintf(stderr, "Need a response of at least 1 byte\n");
+                        exit(-1);
+                      }
+                      printf("Responses are %d bytes\n\n", response);
+                      break;
+
+            case 'x': /* -x ns, optionally ,e for exponential */
+                      strcpy(s2,optarg);
+                      if((pstr=strtok(s2,",")) != NULL) {
+                         service = atof(pstr) * 1.0e-9;
+                         if((pstr=strtok((char *)NULL,",")) != NULL)
+                            service_exp = (pstr[0] == 'e');
+                      }
+                      printf("The receiver works %s%g ns on each request\n\n",
+                             service_exp ? "an exponential mean of " : "",
+                             service * 1.0e9);
+                      break;
+
+            case 'M': inflight = atoi(optarg);
+                      if (inflight < 1)
+                      {
+                        fprintf(stderr, "Need at least 1 message in flight\n");
+                        exit(-1);
+                      }
+                      printf("Measuring the message rate with up to %d messages\n", inflight);
+                      printf("in flight.\n\n");
+                      break;
+
+            case 'L': loops = atoi(optarg);
+                      if (loops < 1 || loops > MAXTRIALS)
+                      {
+                        fprintf(stderr, "Need between 1 and %d loops\n", MAXTRIALS);
+                        exit(-1);
+                      }
+                      printf("Measuring the whole curve %d times\n\n", loops);
+                      break;
+
+            case 'k': discard = atoi(optarg);
+                      printf("Discarding the first %d trials of each point as warmup\n\n",
+                             discard);
+                      break;
+
+            case 'w': /* -w iterations or -w seconds's', optionally ,percent */
+                      strcpy(s2,optarg);
+                      if((pstr=strtok(s2,",")) != NULL) {
+                         if(strchr(pstr,'s') != NULL)
+                            warmup_t = atof(pstr);
+                         else
+                            warmup_n = atoi(pstr);
+                         if((pstr=strtok((char *)NULL,",")) != NULL)
+                            warmup_pct = atof(pstr);
+                      }
+                      if(warmup_n > 0)
+                         printf("Warming up with %d untimed iterations per point", warmup_n);
+                      else
+                         printf("Warming up for %g seconds per point", warmup_t);
+                      if(warmup_pct > 0.0)
+                         printf(",\nthen until the latency is stable within %g%%", warmup_pct);
+                      printf("\n\n");
+                      break;
+
+            case 'F': if( !strcmp(optarg, "json") ) {
+                         format = OUT_JSON;
+                      } else if( !strcmp(optarg, "csv") ) {
+                         format = OUT_CSV;
+                      } else if( !strcmp(optarg, "plain") ) {
+                         format = OUT_PLAIN;
+                      } else {
+                         fprintf(stderr, "Invalid output format, please "
+                                 "choose one of plain, json, csv\n");
+                         exit(-1);
+                      }
+                      break;
+
+            case 'H': histopt = 1;
+                      printf("Recording a latency histogram for every point\n\n");
+                      break;
+
 	    case 'X': debug_wait = 1;
 		      printf("Enableing debug wait!\n");
 		      printf("Attach to pid %d and set debug_wait to 0 to conttinue\n", getpid());
@@ -433,20 +930,281 @@ int main(int argc, char **argv)
    }
 #endif   
    
+#if defined(FANOUT)
+   /* -h host:port gives the port of that receiver, -P that of the others */
+   for (i = 0; i < nfan; i++)
+   {
+       fanport[i] = args.port;
+       if ((pstr = strchr(fanhost[i], ':')) != NULL)
+       {
+           *pstr = '\0';
+           fanport[i] = atoi(pstr+1);
+       }
+   }
+   if (args.host != NULL && (pstr = strchr(args.host, ':')) != NULL)
+   {
+       *pstr = '\0';
+       args.port = atoi(pstr+1);
+   }
+   if (nfan)
+       printf("Fanning out each request to %d receivers and waiting for\n"
+              "every reply.\n\n", nfan+1);
+#endif
+
+   if (nfan && (streamopt || args.bidir || integCheck || inflight || orate > 0.0 ||
+                ntrace || nstreams || pass.winmax || args.reset_conn))
+   {
+       fprintf(stderr, "Fanning out (-h more than once) can't be used with -s, -2, -i,\n"
+                       "-M, -Q, -j, -T, -V, -W or -r\n");
+       exit(-1);
+   }
+
+   if (pass.nload && (streamopt || args.bidir || integCheck || inflight || orate > 0.0 ||
+                 ntrace || nstreams || pass.winmax || nfan))
+   {
+       fprintf(stderr, "Bulk load (-U) can't be used with -s, -W, -2, -i, -M, -Q,\n"
+                       "-j, -T, -V or more than one -h\n");
+       exit(-1);
+   }
+
+   if (pass.zcopt && (args.bidir || orate > 0.0 || nstreams || nfan || pass.nload))
+   {
+       fprintf(stderr, "Zero-copy (-Z) can't be used with -2, -Q, -T, -V, -U\n"
+                       "or more than one -h\n");
+       exit(-1);
+   }
+   if (pass.npoll && (orate > 0.0 || nstreams || nfan || pass.nload || pass.zcopt))
+   {
+       fprintf(stderr, "Receive policies (-J) can't be used with -Q, -T, -V, -U, -Z\n"
+                       "or more than one -h\n");
+       exit(-1);
+   }
+#if defined(ZC_RECV)
+   if (pass.zcopt > ZC_SEND && integCheck)
+   {
+       fprintf(stderr, "Zero-copy receives (-Z r) leave the data mapped, not in\n"
+                       "the receive buffer, so can't be used with -i\n");
+       exit(-1);
+   }
+#endif
+
+   if (daemonopt && args.tr)
+   {
+       fprintf(stderr, "Only the receiver can run as a daemon (-K)\n");
+       exit(-1);
+   }
+
+   if (inflight && (streamopt || args.bidir || integCheck))
+   {
+       fprintf(stderr, "Message rate mode (-M) can't be used with -s, -W, -2 or -i\n");
+       exit(-1);
+   }
+   if ((response || service > 0.0) && (streamopt || args.bidir || integCheck))
+   {
+       fprintf(stderr, "Responses (-y) and service times (-x) need replies,\n"
+                       "so can't be used with -s, -W, -2 or -i\n");
+       exit(-1);
+   }
+   if (ntrace && (streamopt || args.bidir || integCheck || inflight ||
+                  orate > 0.0 || response || service > 0.0))
+   {
+       fprintf(stderr, "Trace replay (-j) can't be used with -s, -W, -2, -i,\n"
+                       "-M, -Q, -x or -y\n");
+       exit(-1);
+   }
+   if (ndist && (args.bidir || integCheck || inflight || orate > 0.0 || ntrace))
+   {
+       fprintf(stderr, "Size distributions (-G) can't be used with -2, -i, -M,\n"
+                       "-Q or -j\n");
+       exit(-1);
+   }
+   if (nstreams && (args.bidir || integCheck || !args.cache || (histopt && !incast) ||
+                    pass.winmax || inflight || orate > 0.0 || ntrace || ndist))
+   {
+       fprintf(stderr, "Concurrent streams (-T) can't be used with -2, -i, -I, -H,\n"
+                       "-W, -M, -Q, -j or -G\n");
+       exit(-1);
+   }
+   if (incast && (streamopt || response || service > 0.0))
+   {
+       fprintf(stderr, "Incast (-V) can't be used with -s, -x or -y\n");
+       exit(-1);
+   }
+   if (orate > 0.0)
+   {
+       if (response && response < sizeof(int))
+           response = sizeof(int);       /* Room for the sequence number */
+       if (streamopt || args.bidir || integCheck || inflight)
+       {
+           fprintf(stderr, "Open-loop mode (-Q) can't be used with -s, -W, -2, -i or -M\n");
+           exit(-1);
+       }
+       start = MAX(start, sizeof(int));   /* Room for the sequence number */
+   }
+
+   TimerInit(timer);
+
    if (start > end)
    {
        fprintf(stderr, "Start MUST be LESS than end\n");
        exit(420132);
    }
-   args.nbuff = TRIALS;
+   if (precision > 0.0 && ! trials_set)
+       trials = MAXTRIALS;    /* Let the stopping rule decide */
+   if (discard < 0)
+   {
+       fprintf(stderr, "Need a warmup trial count (-k) of at least 0\n");
+       exit(-1);
+   }
+   if (discard >= trials)
+   {
+       fprintf(stderr, "Need more trials (-N) than warmup trials (-k)\n");
+       exit(-1);
+   }
+   args.nbuff = trials;
+
+   /* Describe the test, both for structured output and for the receiver */
+   runinfo.start = start;
+   runinfo.end = end;
+   runinfo.perturbation = perturbation;
+   runinfo.nrepeat = nrepeat_const;
+   runinfo.stream = streamopt;
+   runinfo.integrity = integCheck;
+   runinfo.trials = trials;
+   runinfo.discard = discard;
+   runinfo.warmup_n = warmup_n;
+   runinfo.histogram = histopt;
+   runinfo.timer = timer;
+   runinfo.runtm = runtm;
+   runinfo.precision = precision;
+   runinfo.budget = budget;
+   runinfo.warmup_t = warmup_t;
+   runinfo.warmup_pct = warmup_pct;
+   runinfo.loops = loops;
+   runinfo.winmax = pass.winmax;
+   runinfo.inflight = inflight;
+   runinfo.orate = orate;
+   runinfo.poisson = poisson;
+   runinfo.response = response;
+   runinfo.service = service;
+   runinfo.service_exp = service_exp;
+   runinfo.trace = ntrace;
+   runinfo.dist = ndist;
+   runinfo.dist_seed = dist_seed;
+   runinfo.streams = nstreams;
+   runinfo.pin = pin;
+   runinfo.incast = incast;
+   runinfo.load = pass.nload;
+   runinfo.zerocopy = pass.zcopt;
+   runinfo.rxpoll = pass.npoll;
 
    Setup(&args);
 
+#if defined(FANOUT)
+   /* Connect to the other receivers.  From here on the TCP module sends
+    * everything to all of them and waits for every reply.
+    */
+   if (nfan)
+   {
+       if ((args.fan = (ArgStruct *)malloc(nfan * sizeof(ArgStruct))) == NULL ||
+           (args.fan_done = (double *)malloc((nfan+1) * sizeof(double))) == NULL ||
+           (fanhist = (Hist *)malloc((nfan+1) * sizeof(Hist))) == NULL)
+       {
+           perror("malloc");
+           exit(1);
+       }
+       for (i = 0; i < nfan; i++)
+       {
+           args.fan[i] = args;
+           args.fan[i].host = fanhost[i];
+           args.fan[i].port = fanport[i];
+           Setup(&args.fan[i]);
+       }
+       args.nfan = nfan;
+   }
+#endif
+
+   /* A daemon comes back here with the next transmitter connected */
+ next_session:
+
+   /* The transmitter sends the whole test configuration, so the receiver
+    * needs no flags other than those of the connection itself, and can
+    * not run a different test than the transmitter by mistake.
+    */
+   if( args.tr )
+   {
+       SendConfig(&args, &runinfo);
+       if (ntrace) SendTrace(&args, trace, ntrace);
+       if (ndist) SendSizes(&args, dsize, ndist);
+   }
+   else if( args.rcv )
+   {
+       if( RecvConfig(&args, &runinfo) > 0 )
+           fprintf(stderr, "Using the transmitter's test configuration "
+                           "in place of local options\n");
+       start = runinfo.start;
+       end = runinfo.end;
+       perturbation = runinfo.perturbation;
+       nrepeat_const = runinfo.nrepeat;
+       streamopt = runinfo.stream;
+       integCheck = runinfo.integrity;
+       trials = runinfo.trials;
+       discard = runinfo.discard;
+       warmup_n = runinfo.warmup_n;
+       histopt = runinfo.histogram;
+       runtm = runinfo.runtm;
+       precision = runinfo.precision;
+       budget = runinfo.budget;
+       warmup_t = runinfo.warmup_t;
+       warmup_pct = runinfo.warmup_pct;
+       loops = runinfo.loops;
+       pass.winmax = runinfo.winmax;
+       inflight = runinfo.inflight;
+       orate = runinfo.orate;
+       poisson = runinfo.poisson;
+       response = runinfo.response;
+       service = runinfo.service;
+       service_exp = runinfo.service_exp;
+       ntrace = RecvTrace(&args, &trace, runinfo.trace);
+       ndist = RecvSizes(&args, &dsize, runinfo.dist);
+       dist_seed = runinfo.dist_seed;
+       nstreams = runinfo.streams;
+       pin = runinfo.pin;
+       incast = runinfo.incast;
+       pass.nload = runinfo.load;
+       pass.zcopt = runinfo.zerocopy;
+       pass.npoll = runinfo.rxpoll;
+       if( args.preburst ) asyncReceive = 1;
+       args.nbuff = trials;
+   }
+
+#if defined(MULTISTREAM)
+   if (nstreams)
+   {
+       st = OpenStreams(&args, nstreams);
+       if ((stream_t = (double *)realloc(stream_t, nstreams * sizeof(double))) == NULL ||
+           (stream_bps = (double *)realloc(stream_bps, nstreams * sizeof(double))) == NULL ||
+           (stream_comp = (double *)realloc(stream_comp, nstreams * sizeof(double))) == NULL)
+       {
+           perror("malloc");
+           exit(1);
+       }
+   }
+#endif
+
+#if defined(ZC_RECV)
+   /* Received pages are mapped whole, so start the buffers, and with
+    * them the tails that are read, on a page.
+    */
+   if (pass.zcopt & ZC_RECV)
+       bufalign = MAX(bufalign, sysconf(_SC_PAGESIZE));
+#endif
+
    if( args.bidir && end > args.upper ) {
       end = args.upper;
       if( args.tr ) {
          printf("The upper limit is being set to %d Bytes\n", end);
-#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
          printf("due to socket buffer size limitations\n\n");
 #endif
    }  }
@@ -475,15 +1233,20 @@ int main(int argc, char **argv)
    }
    else out = stdout;
 
-      /* Set a starting value for the message size increment. */
-
-   inc = (start > 1) ? start / 2 : 1;
-   nq = (start > 1) ? 1 : 0;
+   /* Record the host for structured output.  The receiver writes its
+    * own records, with the energy data, to stdout.
+    */
+   if( format != OUT_PLAIN )
+   {
+       GetHostInfo(&runinfo);
+       if (sessions == 0) WriteHeader(out, format);
+   }
 
       /* Test the timing to set tlast for the first test */
 
    args.bufflen = start;
    MyMalloc(&args, args.bufflen, 0, 0);
+   if (args.cache) args.s_buff = args.r_buff; /* One shared buffer */
    InitBufferData(&args, args.bufflen, 0, 0);
    
    args.r_ptr = args.r_buff_orig = args.r_buff;
@@ -492,7 +1255,7 @@ int main(int argc, char **argv)
    AfterAlignmentInit(&args);  /* MPI-2 needs this to create a window */
 
    /* Sync to prevent race condition in armci module */
-   //Sync(&args);    
+   Sync(&args);    
 
    /* For simplicity's sake, even if the real test below will be done in
     * bi-directional mode, we still do the ping-pong one-way-at-a-time test
@@ -500,7 +1263,7 @@ int main(int argc, char **argv)
     * longer to send data in both directions at once than it does to send data
     * one way at a time, this shouldn't be too far off anyway.
     */
-   /*t0 = When();
+   t0 = When();
       for( n=0; n<100; n++) {
          if( args.tr) {
             SendData(&args);
@@ -514,7 +1277,7 @@ int main(int argc, char **argv)
             SendData(&args);
          }
       }
-   tlast = (When() - t0)/200;*/
+   tlast0 = (When() - t0 - timer_overhead)/200;
 
    /* Sync up and Reset before freeing the buffers */
 
@@ -523,7 +1286,10 @@ int main(int argc, char **argv)
    Reset(&args);
    
    /* Free the buffers and any other module-specific resources. */
-   FreeBuff(args.r_buff_orig, args.s_buff_orig);
+   if (args.cache)
+     FreeBuff(args.r_buff_orig, NULL);
+   else
+     FreeBuff(args.r_buff_orig, args.s_buff_orig);
 
    /* Do setup for no-cache mode, using two distinct buffers. */
    if (!args.cache)
@@ -559,228 +1325,3306 @@ int main(int argc, char **argv)
        args.r_ptr = args.r_buff+args.roffset;
    }
 
+   /* The receiver reads the package energy around each timed loop, so
+    * probe the RAPL MSRs once up front.  Energy is only sampled if the
+    * probe succeeded.
+    */
+   if( args.rcv && sessions == 0 )
+   {
+     int cpu_model=detect_cpu();
+     int core=0;
+     detect_packages();
+     rapl_ok = (rapl_msr(core,cpu_model) == 0);
+   }
+
+   /* With -L the whole curve is measured loops times over the same
+    * connection, each loop starting from the first size again.  All
+    * loops are done for each curve of the run, see NextPass().
+    */
+   pass.window = pass.winmax ? 1 : 0;
+   pass.nsend = incast ? 1 : nstreams;
+   pass.maxsend = incast ? nstreams : 0;
+   pass.load = 0;
+   pass.zerocopy = 0;
+   pass.policy = 0;
+   loop = 0;
+ next_loop:
+   runinfo.loop = loop;
+   runinfo.window = pass.window;
+   PassStart(&args, &pass);
+
+#if defined(BULKLOAD)
+   if (pass.load > 0)
+       bulk = BulkStart(&args, pass.loadbuf[pass.load-1]);
+#endif
+
+      /* Set a starting value for the message size increment. */
+
+   inc = (start > 1) ? start / 2 : 1;
+   nq = (start > 1) ? 1 : 0;
+   tlast = tlast0;
+   llast = start;
+   orate_cur = orate;
+
    /**************************
     * Main loop of benchmark *
     **************************/
    
    if( args.tr ) fprintf(stderr,"Now starting the main loop\n");
 
-   Sync(&args);    /* Sync to prevent race condition in armci module */
-   
-   /* Calculate how many times to repeat the experiment. */
-   if( args.tr )
+   /* A replayed trace is a single data point with buffers for its
+    * largest message, timing each record on the transmitter.
+    */
+   for (j = 0, tracemax = 0, tracebytes = 0.0; j < ntrace; j++)
    {
-     nrepeat = nrepeat_const;
-     SendRepeat(&args, nrepeat);
+       tracemax = MAX(tracemax, trace[j].size);
+       tracebytes += trace[j].size;
    }
-   else if( args.rcv )
+   if (ntrace && args.tr)
    {
-     RecvRepeat(&args, &nrepeat);
+       rec_lat = (double *)realloc(rec_lat, ntrace * sizeof(double));
+       rec_sum = (double *)realloc(rec_sum, ntrace * sizeof(double));
+       if (rec_lat == NULL || rec_sum == NULL)
+       {
+           perror("malloc");
+           exit(1);
+       }
    }
 
-   args.bufflen = start;
-     
-   if( args.tr )
-     fprintf(stderr,"%3d: %7d bytes %6d times --> ",
-	     n,args.bufflen,nrepeat);
-
-   /* this isn't truly set up for offsets yet */
-   /* Size of an aligned memory block including trailing padding */
-   len_buf_align = args.bufflen;
-   if(bufalign != 0)
-     len_buf_align += bufalign - args.bufflen % bufalign;
-   
-   /* Initialize the buffers with data
-    *
-    * See NOTE above.
+   /* A size distribution is a single data point with buffers for the
+    * largest size of the table.  Latencies are kept per size bucket too.
+    */
+   for (j = 0, distmax = 0, distmean = 0.0; j < ndist; j++)
+   {
+       distmax = MAX(distmax, dsize[j]);
+       distmean += (double)dsize[j] / ndist;
+   }
+   if (ndist && sizehist == NULL &&
+       (sizehist = (Hist *)malloc(NSIZEBKT * sizeof(Hist))) == NULL)
+   {
+       perror("malloc");
+       exit(1);
+   }
+
+   /* Under bulk load each point is compared with the same point of the
+    * idle curve, as the zero-copy curve is with the copying one and each
+    * polling curve with the blocking one.
+    */
+   if (pass.nload)
+       BaseAlloc(&pass.idle);
+   if (pass.zcopt)
+       BaseAlloc(&pass.copy);
+   if (pass.npoll)
+       BaseAlloc(&pass.block);
+
+   /* RPC emulation: the reply may differ in size from the request and
+    * the receiver may work on each request before replying.  Times are
+    * then full round trips instead of half of one, as they are when
+    * fanning out to several receivers.
     */
-   InitBufferData(&args, MEMSIZE, args.soffset, args.roffset); 
+   rpc = (response > 0 || service > 0.0 || nfan > 0);
+
+   /* The transmitter drives the signature curve.  Before each point it
+    * sends the number of repeats followed by the message size, and a
+    * repeat count of 0 once it is done, so the receiver simply follows
+    * along and does not need matching -l, -u or -p values.
+    */
+   for ( n = 0, len = start, errFlag = 0, done = 0; 
+        n < NSAMP - 3 && !done && !errFlag &&
+        (!args.tr || (tlast < STOPTM && len <= end)); 
+        len = len + inc, nq++ )
+   {
+
+           /* Exponentially increase the block size.  */
+
+       if (nq > 2) inc = ((nq % 2))? inc + inc: inc;
+       
+          /* This is a perturbation loop to test nearby values */
+
+       for (pert = ((perturbation > 0) && (inc > perturbation+1)) ? -perturbation : 0;
+            pert <= perturbation && !done; 
+            n++, pert += ((perturbation > 0) && (inc > perturbation+1)) ? perturbation : perturbation+1)
+       {
+
+           Sync(&args);    /* Sync to prevent race condition in armci module */
+
+               /* Calculate how many times to repeat the experiment. */
+
+           if( args.tr )
+           {
+               args.bufflen = len + pert;
+
+               /* Scale the time of the last point up to the new size and
+                * repeat enough times for each trial to last about runtm.
+                * A ping-pong repeat costs two one-way transmissions.
+                */
+               if (nrepeat_const) {
+                   nrepeat = nrepeat_const;
+               } else {
+                   nrepeat = MAX(runtm / ((double)args.bufflen / llast * tlast
+                                          * (streamopt || inflight ? 1 : 2)), TRIALS);
+                   nrepeat = MIN(nrepeat, MAXINT);
+               }
+
+               /* An open-loop curve keeps the message size and doubles
+                * the offered load, each trial lasting about runtm.
+                */
+               if (orate > 0.0) {
+                   args.bufflen = start;
+                   if (!nrepeat_const)
+                       nrepeat = MIN(MAX(orate_cur * runtm, TRIALS), MAXINT);
+               }
+
+               if (ntrace) {
+                   args.bufflen = tracemax;
+                   nrepeat = ntrace;
+                   memset(rec_sum, 0, ntrace * sizeof(double));
+               }
+
+               /* Sizes are drawn before anything is timed.  Repeat for
+                * about runtm at the latency, but no more than once
+                * through the table.
+                */
+               if (ndist) {
+                   args.bufflen = distmax;
+                   if (!nrepeat_const)
+                       nrepeat = MIN(MAX(runtm / (tlast * (streamopt ? 1 : 2)),
+                                         TRIALS), ndist);
+               }
+
+               if (incast &&
+                   (lat_round = (double *)realloc(lat_round, nrepeat * sizeof(double))) == NULL)
+               {
+                   perror("malloc");
+                   exit(1);
+               }
+
+               /* In rate mode, keep no more in flight than the socket
+                * buffers of both directions hold, or both sides could
+                * block in SendData() with nobody reading.
+                */
+               nflight = inflight;
+               if (inflight && args.upper > 0)
+                   nflight = MAX(1, MIN(inflight, args.upper / (2 * args.bufflen)));
+               SendRepeat(&args, nrepeat);
+               SendRepeat(&args, args.bufflen);
+           }
+           else if( args.rcv )
+           {
+               RecvRepeat(&args, &nrepeat);
+               if (nrepeat == 0) {
+                   done = 1;
+                   break;
+               }
+               RecvRepeat(&args, &args.bufflen);
+           }
+
+           if( args.tr )
+           {
+               fprintf(stderr,"%3d: %7d bytes %6d times ",
+                       n,args.bufflen,nrepeat);
+               if (pass.window)
+                   fprintf(stderr,"in windows of %d ", pass.window);
+               if (inflight)
+                   fprintf(stderr,"%d in flight ", nflight);
+               if (orate > 0.0)
+                   fprintf(stderr,"at %.0lf/s ", orate_cur);
+               if (incast)
+                   fprintf(stderr,"from %d sender%s ", pass.nsend, pass.nsend > 1 ? "s" : "");
+               fprintf(stderr,"--> ");
+           }
+
+           if (args.cache) /* Allow cache effects.  We use only one buffer */
+           {
+               /* Allocate the buffer with room for alignment*/
+
+               MyMalloc(&args, MAX(args.bufflen, response)+bufalign,
+                        args.soffset, args.roffset); 
+
+               /* Save buffer address */
+
+               args.r_buff_orig = args.r_buff;
+               args.s_buff_orig = args.r_buff;
+
+               /* Align the buffer */
+
+               args.r_buff = AlignBuffer(args.r_buff, bufalign);
+
+               /* Initialize buffer and write in the same buffer */
+
+               args.s_buff = args.r_buff;
+
+               /* Post alignment initialization */
+
+               AfterAlignmentInit(&args);
+
+               /* Initialize the buffers with data
+                *
+                * See NOTE above.
+                */
+               InitBufferData(&args, args.bufflen, args.soffset, args.roffset); 
+
+               /* Set buffer pointers to beginning of buffer */
+
+               args.r_ptr = args.r_buff+args.roffset;
+               args.s_ptr = args.s_buff+args.soffset;
+           }
+           else /* Eliminate cache effects.  We use two distinct buffers */
+           {
+               /* this isn't truly set up for offsets yet */
+               /* Size of an aligned memory block including trailing padding */
+               len_buf_align = MAX(args.bufflen, response);
+               if(bufalign != 0)
+                 len_buf_align += bufalign - args.bufflen % bufalign;
    
-   /* Reset buffer pointers to beginning of pools */
-   args.r_ptr = args.r_buff+args.roffset;
-   args.s_ptr = args.s_buff+args.soffset;
+               /* Initialize the buffers with data
+                *
+                * See NOTE above.
+                */
+               InitBufferData(&args, MEMSIZE, args.soffset, args.roffset); 
    
-   bwdata[n].t = LONGTIME;
+               /* Reset buffer pointers to beginning of pools */
+               args.r_ptr = args.r_buff+args.roffset;
+               args.s_ptr = args.s_buff+args.soffset;
+           }
+
+           bwdata[n].t = LONGTIME;
+           HistReset(&lathist);
+           for (j = 0; fanhist != NULL && j <= nfan; j++)
+             HistReset(&fanhist[j]);
+           for (j = 0; ndist && j < NSIZEBKT; j++)
+             HistReset(&sizehist[j]);
+
+           /* Warm up before anything is timed, so the first trial does
+            * not pay for page faults, slow start, cold caches or the CPU
+            * clock ramping up.  The transmitter runs untimed iterations
+            * in blocks, announcing each block's length and a 0 at the
+            * end, until the requested iterations or time are done and,
+            * if asked, two blocks in a row agree within warmup_pct.
+            */
+           if( args.tr )
+           {
+             t0 = When();
+             wlast = 0.0;
+             for (wdone = 0; !integCheck && (warmup_n > 0 || warmup_t > 0.0); )
+             {
+               wblk = MAX(1, nrepeat/10);
+               if (warmup_n > 0 && wdone < warmup_n)
+                 wblk = MIN(wblk, warmup_n - wdone);
+
+               SendRepeat(&args, wblk);
+               t1 = When();
+#if defined(INCAST)
+               if (incast)
+                 Incast(st, pass.nsend, args.bufflen, wblk, pin, NULL, NULL);
+               else
+#endif
+#if defined(MULTISTREAM)
+               if (nstreams)
+                 MultiStream(st, nstreams, args.bufflen, wblk, streamopt,
+                             response, 0.0, 0, pin, NULL);
+               else
+#endif
+               for (j = 0; j < wblk; j++)
+               {
+                 if (ndist) args.bufflen = dsize[j % ndist];
+                 SendData(&args);
+                 if (pass.window && ((j+1) % pass.window == 0 || j == wblk-1))
+                   RecvRepeat(&args, &ack);
+                 if (!streamopt)
+                 {
+                   RecvResponse(&args, response);
+                   if(!args.cache)
+                     AdvanceRecvPtr(&args, len_buf_align);
+                 }
+                 if (!args.cache)
+                   AdvanceSendPtr(&args, len_buf_align);
+               }
+               t2 = (When() - t1) / wblk;
+               wdone += wblk;
+
+               /* Enough warmup done?  Give up on stability after 10
+                * times the requested amount.
+                */
+               if (warmup_n > 0 ? wdone >= warmup_n : When() - t0 >= warmup_t)
+               {
+                 if (warmup_pct <= 0.0 ||
+                     (wlast > 0.0 && fabs(t2 - wlast) <= wlast * warmup_pct / 100.0) ||
+                     (warmup_n > 0 ? wdone >= 10*warmup_n : When() - t0 >= 10*warmup_t))
+                   break;
+               }
+               wlast = t2;
+             }
+             SendRepeat(&args, 0);
+           }
+           else if( args.rcv )
+           {
+             for (RecvRepeat(&args, &wblk); wblk > 0; RecvRepeat(&args, &wblk))
+             {
+#if defined(INCAST)
+               if (incast)
+                 Incast(st, pass.nsend, args.bufflen, wblk, pin, NULL, NULL);
+               else
+#endif
+#if defined(MULTISTREAM)
+               if (nstreams)
+                 MultiStream(st, nstreams, args.bufflen, wblk, streamopt,
+                             response, service, service_exp, pin, NULL);
+               else
+#endif
+               for (j = 0; j < wblk; j++)
+               {
+                 if (ndist) args.bufflen = dsize[j % ndist];
+                 RecvData(&args);
+                 if (!args.cache)
+                   AdvanceRecvPtr(&args, len_buf_align);
+                 if (pass.window && ((j+1) % pass.window == 0 || j == wblk-1))
+                   SendRepeat(&args, j+1);
+                 if (!streamopt)
+                 {
+                   if (rpc) ServiceTime(service, service_exp);
+                   SendResponse(&args, response);
+                   if(!args.cache)
+                     AdvanceSendPtr(&args, len_buf_align);
+                 }
+               }
+             }
+           }
    
-   /* Finally, we get to transmit or receive and time */
-   /* NOTE: If a module is running that uses only one process (e.g.
-    * memcpy), we assume that it will always have the args.tr flag
-    * set.  Thus we make some special allowances in the transmit 
-    * section that are not in the receive section.
+           /* Finally, we get to transmit or receive and time */
+           /* NOTE: If a module is running that uses only one process (e.g.
+            * memcpy), we assume that it will always have the args.tr flag
+            * set.  Thus we make some special allowances in the transmit 
+            * section that are not in the receive section.
+            */
+           tstart = When();
+           getrusage(RUSAGE_SELF, &ru0);
+           sys0 = args.syscalls;
+           rxc0 = args.rxcalls;
+           rxb0 = args.rxblocks;
+#if defined(BULKLOAD)
+           if (bulk != NULL)
+             bulk0 = bulk->bytes;
+#endif
+#if defined(ZEROCOPY)
+           zc0_sent = args.prot.zc_sent;
+           zc0_copied = args.prot.zc_copied;
+#endif
+#if defined(ZC_RECV)
+           zc0_rbytes = args.prot.zc_rbytes;
+           zc0_mapped = args.prot.zc_mapped;
+#endif
+           if( args.tr)
+           {
+             /*
+               This is the transmitter: send the block once per trial, and
+               if we are not streaming, expect the receiver to return each
+               block.  After each trial, tell the receiver whether another
+               one follows.
+             */
+             for (i = 0, more = 1; more; i++)
+             {                    
+               /* Warmup trials are left out of the histogram too */
+               if (i == discard)
+               {
+                 HistReset(&lathist);
+                 for (j = 0; fanhist != NULL && j <= nfan; j++)
+                   HistReset(&fanhist[j]);
+                 for (j = 0; ndist && j < NSIZEBKT; j++)
+                   HistReset(&sizehist[j]);
+               }
+
+               /* Flush the cache using the dummy buffer */
+               if (!args.cache)
+                 flushcache(memcache, MEMSIZE/sizeof(int));
+
+               Sync(&args);
+               t0 = tj = When();
+               if (ntrace)
+                 Replay(&args, trace, ntrace, rec_lat);
+               else
+#if defined(INCAST)
+               if (incast)
+               {
+                 Incast(st, pass.nsend, args.bufflen, nrepeat, pin, lat_round, NULL);
+                 for (j = 0; j < nrepeat; j++)
+                   HistAdd(&lathist, lat_round[j]);
+               }
+               else
+#endif
+#if defined(MULTISTREAM)
+               if (nstreams)
+                 MultiStream(st, nstreams, args.bufflen, nrepeat, streamopt,
+                             response, 0.0, 0, pin, stream_t);
+               else
+#endif
+#if defined(OPENLOOP)
+               if (orate > 0.0)
+                 OpenLoop(&args, nrepeat, orate_cur, poisson, response, &lathist);
+               else
+#endif
+               for (j = 0, sent = 0; j < nrepeat; j++)
+               {
+                 /* In rate mode, top up to nflight outstanding messages
+                  * and then take one reply per iteration.
+                  */
+                 if (inflight)
+                   for (; sent < nrepeat && sent < j + nflight; sent++)
+                   {
+                     SendData(&args);
+                     if (!args.cache)
+                       AdvanceSendPtr(&args, len_buf_align);
+                   }
+                 else
+                 {
+                   if (integCheck) SetIntegrityData(&args);
+
+                   if (ndist) args.bufflen = dsize[j % ndist];
+                   SendData(&args);
+                 }
+
+                 /* In window mode, wait for the receiver to acknowledge
+                  * each full window and the last partial one.
+                  */
+                 if (pass.window && ((j+1) % pass.window == 0 || j == nrepeat-1))
+                   RecvRepeat(&args, &ack);
+
+                 if (!streamopt)
+                 {
+                   RecvResponse(&args, response);
+
+                   if (integCheck) VerifyIntegrity(&args);
+
+                   if(!args.cache)
+                     AdvanceRecvPtr(&args, len_buf_align);
+                 }
+                 /* Wait to advance send pointer in case RecvData uses
+                  * it (e.g. memcpy module).
+                  */
+                 if (!args.cache && !inflight)
+                   AdvanceSendPtr(&args, len_buf_align);
+
+                 /* Chain the timestamps so each iteration costs one
+                  * extra clock read, whose cost is taken back out.  Like
+                  * t below, a ping-pong iteration is recorded as half
+                  * the round trip.
+                  */
+                 if (histopt)
+                 {
+                   t1 = When();
+                   t2 = t1 - tj - timer_overhead;
+                   if (!streamopt && !inflight && !rpc)
+                     t2 /= 2;
+                   HistAdd(&lathist, t2);
+                   if (ndist)
+                     HistAdd(&sizehist[SizeBucket(args.bufflen)], t2);
+                   for (k = 0; nfan && k <= nfan; k++)  /* Each receiver's reply */
+                     HistAdd(&fanhist[k], args.fan_done[k] - tj - timer_overhead);
+                   tj = t1;
+                 }
+               }
+
+               /* t is the 1-directional trasmission time, or the time
+                * per message in rate mode.
+                */
+               t = (When() - t0 - timer_overhead)/ nrepeat;
+               if (ndist) args.bufflen = distmax;
+
+               if (!streamopt && !inflight && orate <= 0.0 && !rpc && !ntrace)
+                 t /= 2; /* Normal ping-pong */
+
+               /* Each trace record's latency goes into the histogram */
+               if (ntrace && i >= discard)
+                 for (j = 0; j < ntrace; j++)
+                 {
+                   HistAdd(&lathist, rec_lat[j]);
+                   rec_sum[j] += rec_lat[j];
+                 }
+
+               Reset(&args);
+
+               /* In streaming mode only the receiver knows when the
+                * last block arrived, so use its time instead.  Each of
+                * several streams waits for the receiver's acknowledgement.
+                */
+               if (streamopt && !nstreams)
+                 RecvTime(&args, &t);
+
+               /* An incast round is timed by the receiver from its first
+                * byte, which also sends each sender's completion time.
+                */
+               if (incast)
+               {
+                 RecvTime(&args, &t);
+                 for (j = 0; j < pass.nsend; j++)
+                   RecvTime(&args, &stream_t[j]);
+               }
+
+        /* NOTE: NetPIPE does each data point TRIALS times, bouncing the message
+         * nrepeats times for each trial, then reports the lowest of the TRIALS
+         * times.  -Dave Turner
+         */
+               if (i >= discard)
+               {
+                 trial_t[i - discard] = t;
+
+                 /* Keep each stream's rate from the fastest trial, and
+                  * each incast sender's completion time and rate.
+                  */
+                 for (j = 0; j < pass.nsend && t < bwdata[n].t; j++)
+                   if (incast)
+                   {
+                     stream_comp[j] = stream_t[j];
+                     stream_bps[j] = args.bufflen * CHARSIZE
+                                     / (stream_t[j] * 1024 * 1024);
+                   }
+                   else
+                     stream_bps[j] = (args.bufflen + response) * CHARSIZE
+                                     / (stream_t[j] / nrepeat / (streamopt || rpc ? 1 : 2)
+                                        * 1024 * 1024);
+                 bwdata[n].t = MIN(bwdata[n].t, t);
+               }
+
+               /* Stop after a fixed number of trials, or once the median
+                * has converged or the time budget for the point is spent.
+                */
+               more = !integCheck && i+1 < trials;
+               if (more && i >= discard)
+               {
+                 if (precision > 0.0 &&
+                     MedianCI(trial_t, i+1-discard, &bwdata[n].tmed,
+                              &bwdata[n].tlo, &bwdata[n].thi) &&
+                     (bwdata[n].thi - bwdata[n].tlo) / 2 <=
+                       bwdata[n].tmed * precision / 100.0)
+                   more = 0;
+                 if (budget > 0.0 && When() - tstart > budget)
+                   more = 0;
+               }
+               SendRepeat(&args, more);
+             }
+
+             bwdata[n].trials = i - discard;
+             MedianCI(trial_t, bwdata[n].trials,
+                      &bwdata[n].tmed, &bwdata[n].tlo, &bwdata[n].thi);
+           }
+           else if( args.rcv )
+           {
+             /*
+               This is the receiver: receive the block once per trial, and
+               if we are not streaming, send the block back to the
+               sender.  The transmitter decides how many trials to run.
+             */
+             for (i = 0, more = 1; more; i++)
+             {
+               /* Flush the cache using the dummy buffer */
+               if (!args.cache)
+                 flushcache(memcache, MEMSIZE/sizeof(int));
+
+               Sync(&args);
+
+               t0 = When();
+
+               if (ntrace)
+               {
+                 work_start = ReadTicks();
+                 Replay(&args, trace, ntrace, NULL);
+               }
+               else
+#if defined(INCAST)
+               if (incast)
+               {
+                 work_start = ReadTicks();
+                 tbusy = Incast(st, pass.nsend, args.bufflen, nrepeat, pin, NULL, stream_t);
+               }
+               else
+#endif
+#if defined(MULTISTREAM)
+               if (nstreams)
+               {
+                 work_start = ReadTicks();
+                 if (rapl_ok) {
+                   pk0_start = read_pkg_energy(0);
+                   pk1_start = read_pkg_energy(1);
+                 }
+                 MultiStream(st, nstreams, args.bufflen, nrepeat, streamopt,
+                             response, service, service_exp, pin, NULL);
+                 if (rapl_ok) {
+                   pk0_joules = calculate_energy(pk0_start, 0);
+                   pk1_joules = calculate_energy(pk1_start, 1);
+                 }
+               }
+               else
+#endif
+               for (j = 0; j < nrepeat; j++)
+               {
+                 if (ndist) args.bufflen = dsize[j % ndist];
+                 RecvData(&args);
+                 if(j == 0) {
+                   work_start = ReadTicks();
+                   if (rapl_ok) {
+                     pk0_start = read_pkg_energy(0);
+                     pk1_start = read_pkg_energy(1);
+                   }
+                   
+                   //pk0_joules = read_package(0);
+                   //pk1_joules = read_package(1);	   
+                 }
+                 if(j == nrepeat-1) {
+                   work_end = ReadTicks();
+
+                   if (rapl_ok) {
+                     pk0_joules = calculate_energy(pk0_start, 0);
+                     pk1_joules = calculate_energy(pk1_start, 1);
+                   }
+                   //pk0_joules = read_package(0) - pk0_joules;
+                   //pk1_joules = read_package(1) - pk1_joules;
+                 }
+
+                 if (integCheck) VerifyIntegrity(&args);
+
+                 /* Return the open-loop sequence number */
+                 if (orate > 0.0 && !args.cache)
+                   memcpy(args.s_ptr, args.r_ptr, sizeof(int));
+                 
+                 if (!args.cache)
+                 { 
+                   AdvanceRecvPtr(&args, len_buf_align);
+                 }
+
+                 if (pass.window && ((j+1) % pass.window == 0 || j == nrepeat-1))
+                   SendRepeat(&args, j+1);
+                                
+                 if (!streamopt)
+                 {
+                   if (integCheck) SetIntegrityData(&args);
+
+                   if (rpc) ServiceTime(service, service_exp);
+
+                   SendResponse(&args, response);
+                   if(!args.cache) 
+                     AdvanceSendPtr(&args, len_buf_align);
+                 }
+               }
+               work_end = ReadTicks();
+               t = (When() - t0 - timer_overhead)/ nrepeat;       
+               if (ndist) args.bufflen = distmax;
+               
+               if (!streamopt && !inflight && orate <= 0.0 && !rpc && !ntrace)
+                 t /= 2; /* Normal ping-pong */
+
+               Reset(&args);
+
+               if (streamopt && !nstreams)
+                 SendTime(&args, &t);
+
+               if (incast)
+               {
+                 t = tbusy / nrepeat;
+                 SendTime(&args, &t);
+                 for (j = 0; j < pass.nsend; j++)
+                   SendTime(&args, &stream_t[j]);
+               }
+
+               bwdata[n].t = MIN(bwdata[n].t, t);
+
+               RecvRepeat(&args, &more);
+             }
+           }   
+
+           /* Swap measurements with the other side so each can write a
+            * record holding both sides' times, energy and CPU use.
+            */
+           getrusage(RUSAGE_SELF, &ru1);
+           MetricsReset(&mlocal);
+           MetricSet(&mlocal, MET_TIME_NS, (long long)(bwdata[n].t * 1.0e9));
+           MetricSet(&mlocal, MET_USER_NS,
+                     (ru1.ru_utime.tv_sec - ru0.ru_utime.tv_sec) * 1000000000LL +
+                     (ru1.ru_utime.tv_usec - ru0.ru_utime.tv_usec) * 1000LL);
+           MetricSet(&mlocal, MET_SYS_NS,
+                     (ru1.ru_stime.tv_sec - ru0.ru_stime.tv_sec) * 1000000000LL +
+                     (ru1.ru_stime.tv_usec - ru0.ru_stime.tv_usec) * 1000LL);
+           MetricSet(&mlocal, MET_MSGS, (long long)i * nrepeat * MAX(pass.nsend, 1));
+           if (args.syscalls >= 0)
+             MetricSet(&mlocal, MET_SYSCALLS, args.syscalls - sys0);
+           if( args.tr )
+           {
+             MetricSet(&mlocal, MET_MEDIAN_NS, (long long)(bwdata[n].tmed * 1.0e9));
+             MetricSet(&mlocal, MET_TRIALS, bwdata[n].trials);
+             if (histopt)
+             {
+               MetricSet(&mlocal, MET_P50_NS,
+                         (long long)(HistPercentile(&lathist, 50.0) * 1.0e9));
+               MetricSet(&mlocal, MET_P99_NS,
+                         (long long)(HistPercentile(&lathist, 99.0) * 1.0e9));
+               MetricSet(&mlocal, MET_MAX_NS, (long long)(lathist.max * 1.0e9));
+             }
+             SendMetrics(&args, &mlocal);
+             RecvMetrics(&args, &mremote);
+#if defined(FANOUT)
+             for (j = 0; j < nfan; j++)   /* Only the first one's are kept */
+               RecvMetrics(&args.fan[j], &mfan);
+#endif
+           }
+           else if( args.rcv )
+           {
+             MetricSet(&mlocal, MET_WORK_START, work_start);
+             MetricSet(&mlocal, MET_WORK_END, work_end);
+             MetricSet(&mlocal, MET_WORK_NS,
+                       (long long)(TicksToSec(work_end - work_start) * 1.0e9));
+             if (rapl_ok)
+             {
+               MetricSet(&mlocal, MET_PKG0_UJ, (long long)(pk0_joules * 1.0e6));
+               MetricSet(&mlocal, MET_PKG1_UJ, (long long)(pk1_joules * 1.0e6));
+             }
+             RecvMetrics(&args, &mremote);
+             SendMetrics(&args, &mlocal);
+           }
+
+           /* Streaming mode doesn't really calculate correct latencies
+            * for small message sizes, and on some nics we can get
+            * zero second latency after doing the math.  Protect against
+            * this.
+            */
+           if(bwdata[n].t == 0.0) {
+             bwdata[n].t = 0.000001;
+           }
+                    
+           tlast = bwdata[n].t;
+           llast = args.bufflen;
+           bwdata[n].bits = args.bufflen * CHARSIZE * (1+args.bidir);
+           bwdata[n].bps = bwdata[n].bits / (bwdata[n].t * 1024 * 1024);
+           if (response)    /* Count the data of both directions */
+             bwdata[n].bps = (args.bufflen + response) * CHARSIZE
+                             / (bwdata[n].t * 1024 * 1024);
+           if (ntrace)      /* t is the mean time per record */
+             bwdata[n].bps = tracebytes / ntrace * CHARSIZE
+                             / (bwdata[n].t * 1024 * 1024);
+           if (ndist)       /* ... or per message of the mean size */
+           {
+             bwdata[n].bits = (int)(distmean * CHARSIZE + 0.5);
+             bwdata[n].bps = (distmean + response) * CHARSIZE
+                             / (bwdata[n].t * 1024 * 1024);
+           }
+           bwdata[n].repeat = nrepeat;
+           bwdata[n].variance = HistVariance(&lathist);
+
+           /* Concurrent streams: the aggregate rate over the time of the
+            * slowest stream, and the Jain fairness index of their rates,
+            * (sum x)^2 / (n sum x^2), which is 1 when all are equal.
+            */
+           bwdata[n].streams = pass.nsend;
+           bwdata[n].jain = 0.0;
+           bwdata[n].stream_bps = bwdata[n].stream_comp = NULL;
+           if (pass.nsend && args.tr)
+           {
+             for (j = 0, ssum = ssq = 0.0; j < pass.nsend; j++)
+             {
+               ssum += stream_bps[j];
+               ssq += stream_bps[j] * stream_bps[j];
+             }
+             bwdata[n].bps *= pass.nsend;
+             bwdata[n].jain = ssq > 0.0 ? ssum * ssum / (pass.nsend * ssq) : 0.0;
+             bwdata[n].stream_bps = stream_bps;
+             if (incast)
+               bwdata[n].stream_comp = stream_comp;
+           }
+
+           /* Fanning out, the data of all receivers counts, and each
+            * one's replies have their own latency histogram.
+            */
+           bwdata[n].targets = nfan ? nfan + 1 : 0;
+           bwdata[n].target_hist = fanhist;
+           if (nfan)
+             bwdata[n].bps *= nfan + 1;
+
+           /* Under bulk load, compare each point with the idle curve */
+#if defined(BULKLOAD)
+           bwdata[n].load_buf = pass.load ? pass.loadbuf[pass.load-1] : -1;
+#else
+           bwdata[n].load_buf = -1;
+#endif
+           bwdata[n].bulk_bps = bwdata[n].inflation = bwdata[n].p99_inflation = 0.0;
+           if (pass.nload && args.tr)
+             CompareLoad(&pass, &bwdata[n], n, loop == 0,
+                         HistPercentile(&lathist, 99.0));
+
+           /* Messages per second and the CPU time each one cost on both
+            * sides, from the exchanged getrusage() counts.
+            */
+           bwdata[n].msgrate = 1.0 / bwdata[n].t;
+           bwdata[n].offered = orate_cur;
+           bwdata[n].cpu_msg = bwdata[n].peer_cpu_msg = -1.0;
+           if (mlocal.have[MET_MSGS] && mlocal.val[MET_MSGS] > 0)
+             bwdata[n].cpu_msg = (mlocal.val[MET_USER_NS] + mlocal.val[MET_SYS_NS])
+                                 / (double)mlocal.val[MET_MSGS];
+           if (mremote.have[MET_MSGS] && mremote.val[MET_MSGS] > 0)
+             bwdata[n].peer_cpu_msg = (mremote.val[MET_USER_NS] + mremote.val[MET_SYS_NS])
+                                      / (double)mremote.val[MET_MSGS];
+           bwdata[n].sys_msg = bwdata[n].peer_sys_msg = -1.0;
+           if (mlocal.have[MET_SYSCALLS] && mlocal.val[MET_MSGS] > 0)
+             bwdata[n].sys_msg = mlocal.val[MET_SYSCALLS] / (double)mlocal.val[MET_MSGS];
+           if (mremote.have[MET_SYSCALLS] && mremote.val[MET_MSGS] > 0)
+             bwdata[n].peer_sys_msg = mremote.val[MET_SYSCALLS]
+                                      / (double)mremote.val[MET_MSGS];
+
+           /* Without copying, compare each point with the copying curve,
+            * and give the share of sends the kernel copied anyway and of
+            * bytes received mapped.
+            */
+           bwdata[n].zerocopy = pass.zerocopy ? pass.zcopt : 0;
+           bwdata[n].zc_speedup = bwdata[n].zc_cpu = bwdata[n].zc_copied = 0.0;
+           bwdata[n].zc_mapped = bwdata[n].zc_saved = 0.0;
+           if (pass.zcopt)
+           {
+             CompareZeroCopy(&pass, &bwdata[n], n, loop == 0, args.bufflen);
+#if defined(ZEROCOPY)
+             if (args.prot.zc_sent != zc0_sent)
+               bwdata[n].zc_copied = (double)(args.prot.zc_copied - zc0_copied)
+                                     / (args.prot.zc_sent - zc0_sent);
+#endif
+#if defined(ZC_RECV)
+             if (args.prot.zc_rbytes != zc0_rbytes)
+               bwdata[n].zc_mapped = (double)(args.prot.zc_mapped - zc0_mapped)
+                                     / (args.prot.zc_rbytes - zc0_rbytes);
+#endif
+           }
+
+           /* With a receive policy, compare each point with the blocking
+            * curve.  The receiver's package energy is given per message
+            * of the last trial, the window it was read over.
+            */
+           bwdata[n].rx_mode = args.rxpoll;
+           bwdata[n].rx_usec = args.rxusec;
+           bwdata[n].rx_gain = bwdata[n].rx_cpu = 0.0;
+           bwdata[n].rx_budget = args.rxbudget;
+           bwdata[n].rx_blocked = args.rxcalls > rxc0 ?
+               (double)(args.rxblocks - rxb0) / (args.rxcalls - rxc0) : 0.0;
+           bwdata[n].rx_joules = -1.0;
+           if (args.tr && mremote.have[MET_PKG0_UJ] && nrepeat > 1)
+             bwdata[n].rx_joules = (mremote.val[MET_PKG0_UJ] + mremote.val[MET_PKG1_UJ])
+                                   * 1.0e-6 / (nrepeat - 1);
+           else if (!args.tr && rapl_ok && nrepeat > 1)
+             bwdata[n].rx_joules = (pk0_joules + pk1_joules) / (nrepeat - 1);
+           if (pass.npoll)
+             ComparePolicy(&pass, &bwdata[n], n, loop == 0, &lathist);
+
+           tend = When();
+           bwdata[n].elapsed = tend - tstart;
+#if defined(BULKLOAD)
+           if (bulk != NULL)
+             bwdata[n].bulk_bps = (bulk->bytes - bulk0) * CHARSIZE
+                                  / ((tend - tstart) * 1024 * 1024);
+#endif
+           /* Only the receiver samples the energy of a point */
+           bwdata[n].work = 0.0;
+           bwdata[n].joules0 = bwdata[n].joules1 = -1.0;
+           if (args.rcv && !args.tr)
+           {
+             bwdata[n].joules0 = rapl_ok ? pk0_joules : -1.0;
+             bwdata[n].joules1 = rapl_ok ? pk1_joules : -1.0;
+             bwdata[n].work = TicksToSec(work_end - work_start);
+           }
+
+           if (format != OUT_PLAIN)
+           {
+             WriteResult(out, format, &runinfo, &args, &bwdata[n],
+                         args.tr ? trial_t : NULL, histopt ? &lathist : NULL,
+                         &mlocal, &mremote);
+           }
+           else if (args.tr)
+           {
+             if(integCheck) {
+               fprintf(out,"%8d %d", bwdata[n].bits / 8, nrepeat);
+
+             } else {
+               fprintf(out,"%8d %lf %.8lf %.6lf",
+                       bwdata[n].bits / 8, bwdata[n].bps, bwdata[n].t, tend-tstart);
+
+               /* Median trial time and its confidence interval */
+               if (precision > 0.0)
+                 fprintf(out," %.8lf %.8lf %.8lf %d", bwdata[n].tmed,
+                         bwdata[n].tlo, bwdata[n].thi, bwdata[n].trials);
+
+               /* Tail percentiles of the per-iteration latencies */
+               if (histopt)
+                 fprintf(out," %.9lf %.9lf %.9lf %.9lf %.9lf %.9lf %.9le",
+                         HistPercentile(&lathist, 50.0),
+                         HistPercentile(&lathist, 90.0),
+                         HistPercentile(&lathist, 99.0),
+                         HistPercentile(&lathist, 99.9),
+                         HistPercentile(&lathist, 99.99),
+                         lathist.max, bwdata[n].variance);
+
+               /* Window size and message rate last, so the other
+                * columns keep their place.
+                */
+               if (pass.window)
+                 fprintf(out," %d", pass.window);
+               if (inflight)
+                 fprintf(out," %.1lf %.1lf %.1lf %d", bwdata[n].msgrate,
+                         bwdata[n].cpu_msg, bwdata[n].peer_cpu_msg, nflight);
+               if (orate > 0.0)
+                 fprintf(out," %.1lf %.1lf", bwdata[n].offered, bwdata[n].msgrate);
+               if (rpc && orate <= 0.0)
+                 fprintf(out," %d %.1lf", response ? response : args.bufflen,
+                         bwdata[n].msgrate);
+               if (ntrace)
+                 fprintf(out," %d %.1lf", ntrace, bwdata[n].msgrate);
+               if (pass.nsend)
+               {
+                 fprintf(out," %d %.4lf", pass.nsend, bwdata[n].jain);
+                 for (j = 0; j < pass.nsend; j++)
+                   fprintf(out," %lf", stream_bps[j]);
+                 for (j = 0; incast && j < pass.nsend; j++)
+                   fprintf(out," %.9lf", stream_comp[j]);
+               }
+               if (nfan)
+               {
+                 fprintf(out," %d", nfan + 1);
+                 for (j = 0; j <= nfan; j++)
+                   fprintf(out," %.9lf %.9lf %.9lf",
+                           HistPercentile(&fanhist[j], 50.0),
+                           HistPercentile(&fanhist[j], 99.0), fanhist[j].max);
+               }
+               if (pass.nload)
+                 fprintf(out," %d %lf %.4lf %.4lf", bwdata[n].load_buf,
+                         bwdata[n].bulk_bps, bwdata[n].inflation,
+                         bwdata[n].p99_inflation);
+               if (pass.zcopt)
+                 fprintf(out," %d %.4lf %.4lf %.4lf %.4lf %.4lf", bwdata[n].zerocopy,
+                         bwdata[n].zc_speedup, bwdata[n].zc_cpu,
+                         bwdata[n].zc_copied, bwdata[n].zc_mapped,
+                         bwdata[n].zc_saved);
+               if (pass.npoll)
+                 fprintf(out," %d %d %.1lf %.1lf %.0lf %.4lf %.6e", bwdata[n].rx_mode,
+                         bwdata[n].rx_usec, bwdata[n].rx_gain, bwdata[n].rx_cpu,
+                         bwdata[n].rx_budget, bwdata[n].rx_blocked,
+                         bwdata[n].rx_joules);
+
+             }
+             fprintf(out, "\n");
+             fflush(out);
+           } else {
+             printf("SERVER_WORKLOAD_PERIOD: %llu %llu %.6f %.6f %.9f\n", work_start, work_end,
+                    pk0_joules, pk1_joules, TicksToSec(work_end - work_start));
+           }
+            
+           /* Free using original buffer addresses since we may have aligned
+              r_buff and s_buff */
+           if (args.cache)
+             FreeBuff(args.r_buff_orig, NULL);
+                    
+           if ( args.tr ) {
+             if(integCheck) {
+               fprintf(stderr, " Integrity check passed\n");
+
+             } else {
+               fprintf(stderr," %8.2lf Mbps in %10.2lf usec, %.6lf sec total", 
+                       bwdata[n].bps, tlast*1.0e6, tend-tstart);
+               if (precision > 0.0)
+                 fprintf(stderr,", median %.2lf [%.2lf, %.2lf] usec in %d trials",
+                         bwdata[n].tmed*1.0e6, bwdata[n].tlo*1.0e6,
+                         bwdata[n].thi*1.0e6, bwdata[n].trials);
+               if (histopt)
+                 fprintf(stderr,", p50 %.2lf p99 %.2lf max %.2lf usec",
+                         HistPercentile(&lathist, 50.0)*1.0e6,
+                         HistPercentile(&lathist, 99.0)*1.0e6,
+                         lathist.max*1.0e6);
+               if (inflight)
+                 fprintf(stderr,", %.0lf msg/s, CPU %.0lf/%.0lf ns/msg",
+                         bwdata[n].msgrate, bwdata[n].cpu_msg,
+                         bwdata[n].peer_cpu_msg);
+               if (orate > 0.0)
+                 fprintf(stderr,", %.0lf/s achieved", bwdata[n].msgrate);
+               else if (rpc)
+                 fprintf(stderr,", %.0lf RPC/s", bwdata[n].msgrate);
+               else if (ntrace)
+                 fprintf(stderr,", %.0lf records/s", bwdata[n].msgrate);
+               if (ndist)
+                 fprintf(stderr,", mean size %.0lf bytes", distmean);
+               if (pass.nsend)
+                 fprintf(stderr,", %d streams, Jain %.4lf", pass.nsend,
+                         bwdata[n].jain);
+               if (nfan)
+               {
+                 fprintf(stderr,", p99 of each receiver");
+                 for (j = 0; j <= nfan; j++)
+                   fprintf(stderr," %.2lf", HistPercentile(&fanhist[j], 99.0)*1.0e6);
+                 fprintf(stderr," usec");
+               }
+               if (pass.load)
+                 fprintf(stderr,", bulk %.0lf Mbps, x%.2lf idle (p99 x%.2lf)",
+                         bwdata[n].bulk_bps, bwdata[n].inflation,
+                         bwdata[n].p99_inflation);
+#if defined(ZEROCOPY)
+               if (pass.zerocopy)
+                 fprintf(stderr,", x%.2lf faster, x%.2lf less CPU than copying",
+                         bwdata[n].zc_speedup, bwdata[n].zc_cpu);
+               if (pass.zerocopy && (pass.zcopt & ZC_SEND))
+                 fprintf(stderr,", %.0lf%% copied", bwdata[n].zc_copied * 100.0);
+               if (pass.zerocopy && pass.zcopt > ZC_SEND)
+                 fprintf(stderr,", %.0lf%% mapped, %.3lf ns/byte less CPU",
+                         bwdata[n].zc_mapped * 100.0, bwdata[n].zc_saved);
+#endif
+               if (pass.policy)
+                 fprintf(stderr,", %.2lf usec faster, %.0lf ns/msg more CPU than blocking",
+                         bwdata[n].rx_gain * 1.0e-3, bwdata[n].rx_cpu);
+#if defined(RXPOLL)
+               if (args.rxpoll == RX_HYBRID || args.rxpoll == RX_ADAPT)
+                 fprintf(stderr,", spin %.2lf usec, %.0lf%% blocked",
+                         bwdata[n].rx_budget * 1.0e-3, bwdata[n].rx_blocked * 100.0);
+#endif
+               if (pass.npoll && bwdata[n].rx_joules >= 0.0)
+                 fprintf(stderr,", %.3lf uJ/msg", bwdata[n].rx_joules * 1.0e6);
+               if (bwdata[n].sys_msg >= 0.0)
+                 fprintf(stderr,", %.2lf/%.2lf syscalls/msg", bwdata[n].sys_msg,
+                         bwdata[n].peer_sys_msg);
+               fprintf(stderr,"\n");
+             }
+
+             /* The mean latency of each trace record goes to its own
+              * file, next to the output file.
+              */
+             if (ntrace)
+             {
+               FILE *rf;
+
+               snprintf(s2, sizeof(s2), "%.*s.records", (int)sizeof(s2) - 9, s);
+               if ((rf = fopen(s2, "w")) == NULL)
+               {
+                 fprintf(stderr,"Can't open %s for output\n", s2);
+                 exit(1);
+               }
+               for (j = 0; j < ntrace; j++)
+                 fprintf(rf, "%d %d %c %.3lf %.3lf\n", j, trace[j].size,
+                         trace[j].dir == TRACE_C2S ? '>' : '<',
+                         trace[j].gap * 1.0e6,
+                         rec_sum[j] / MAX(bwdata[n].trials, 1) * 1.0e6);
+               fclose(rf);
+               done = 1;
+             }
+
+             /* The latency of each size bucket goes to its own file too,
+              * with a last line of sizes 0 0 for all of them.
+              */
+             if (ndist)
+             {
+               FILE *sf;
+
+               snprintf(s2, sizeof(s2), "%.*s.sizes", (int)sizeof(s2) - 7, s);
+               if ((sf = fopen(s2, loop == 0 && pass.window <= 1 && pass.load == 0 && pass.zerocopy == 0 && pass.policy == 0 ? "w" : "a")) == NULL)
+               {
+                 fprintf(stderr,"Can't open %s for output\n", s2);
+                 exit(1);
+               }
+               for (j = 0; j <= NSIZEBKT; j++)
+               {
+                 Hist *h = j < NSIZEBKT ? &sizehist[j] : &lathist;
+
+                 if (h->total == 0)
+                   continue;
+                 fprintf(sf, "%d %d %d %d %lld %.3lf %.3lf %.3lf %.3lf\n",
+                         loop, pass.window, j < NSIZEBKT ? 1 << j : 0,
+                         j < NSIZEBKT ? (int)((2LL << j) - 1) : 0, h->total,
+                         HistMean(h) * 1.0e6, HistPercentile(h, 50.0) * 1.0e6,
+                         HistPercentile(h, 99.0) * 1.0e6, h->max * 1.0e6);
+               }
+               fclose(sf);
+               done = 1;
+             }
+
+             /* The open-loop curve ends once the load can't be served */
+             if (orate > 0.0)
+             {
+               if (bwdata[n].msgrate < 0.9 * orate_cur)
+                 done = 1;
+               orate_cur *= 2;
+             }
+           }
+
+       } /* End of perturbation loop */
+
+   } /* End of main loop  */
+
+   /* Tell the receiver that there are no more points to measure.  It
+    * syncs before reading each repeat count, so sync here too.
     */
-   tstart = When();
-   if( args.tr)
+   if( args.tr )
    {
-     /*
-       This is the transmitter: send the block TRIALS times, and
-       if we are not streaming, expect the receiver to return each
-       block.
-     */
-     for (i = 0; i < TRIALS; i++)
-     {                    
-       /* Flush the cache using the dummy buffer */
-       if (!args.cache)
-	 flushcache(memcache, MEMSIZE/sizeof(int));
-
-       Sync(&args);
-       t0 = When();
-       for (j = 0; j < nrepeat; j++)
+     Sync(&args);
+     SendRepeat(&args, 0);
+   }
+   else if( args.rcv && !done )
+   {
+     Sync(&args);
+     RecvRepeat(&args, &nrepeat);
+   }
+
+#if defined(BULKLOAD)
+   if (bulk != NULL)
+   {
+     BulkStop(bulk);
+     bulk = NULL;
+   }
+#endif
+
+   if( args.tr && pass.zerocopy && loop == loops-1 )
+     ZeroCopySummary(stderr, bwdata, n);
+
+   /* Keep each point's time for the summary across loops, and start the
+    * next loop, over a new connection if -r is given.
+    */
+   if( args.tr && loops > 1 )
+   {
+     if (loop == 0)
+     {
+       npts = n;
+       if ((loop_t = (double *)malloc(npts * loops * sizeof(double))) == NULL)
        {
-	 SendData(&args);
-	 if (!streamopt)
-	 {
-	   RecvData(&args);
-	   if(!args.cache)
-	     AdvanceRecvPtr(&args, len_buf_align);
-	 }
-	 /* Wait to advance send pointer in case RecvData uses
-	  * it (e.g. memcpy module).
-	  */
-	 if (!args.cache)
-	   AdvanceSendPtr(&args, len_buf_align);
+         perror("malloc");
+         exit(1);
        }
+     }
+     for (j = 0; j < npts; j++)
+       loop_t[j*loops + loop] = j < n ? bwdata[j].t : 0.0;
+   }
+   if( ++loop < loops )
+   {
+     if (args.tr && format == OUT_PLAIN)
+       fprintf(out, "\n");     /* A blank line between loops */
+     Reset(&args);
+     goto next_loop;
+   }
+   if( args.tr && loops > 1 )
+   {
+     PassLabel(stderr, &pass);
+     LoopSummary(stderr, bwdata, npts, loop_t, loops);
+     free(loop_t);
+     loop_t = NULL;
+   }
+
+   /* Then measure the next curve of the run, if there is one */
+   if( NextPass(&pass) )
+   {
+     if (args.tr && format == OUT_PLAIN)
+       fprintf(out, "\n");     /* ... and between curves */
+     loop = 0;
+     Reset(&args);
+     goto next_loop;
+   }
+#if defined(RXPOLL)
+   if( args.tr && pass.npoll )
+     PolicySummary(stderr, &pass);
+#endif
+ 
+   /* Free using original buffer addresses since we may have aligned
+      r_buff and s_buff */
+
+   if (!args.cache) {
+        FreeBuff(args.s_buff_orig, args.r_buff_orig);
+        free(memcache);
+   }
+   if (args.tr) fclose(out);
+
+#if defined(MULTISTREAM)
+   if (nstreams)
+   {
+       CloseStreams(st, nstreams);
+       st = NULL;
+   }
+#endif
+
+   /* A daemon closes the session's connection, keeping the listening
+    * socket, timer calibration and RAPL state, and accepts the next one.
+    */
+   if (daemonopt)
+   {
+       fflush(stdout);
+       reset_connection = args.reset_conn;
+       args.reset_conn = 1;
+       Reset(&args);
+       args.reset_conn = reset_connection;
+       sessions++;
+       goto next_session;
+   }
+         
+    CleanUp(&args);
+    return 0;
+}
+
+
+/* Timer layer.  When() reads either clock_gettime(CLOCK_MONOTONIC_RAW),
+ * which is monotonic and not slewed by NTP, or the CPU's invariant cycle
+ * counter (x86 TSC, ARM virtual counter), which is cheaper to read and
+ * has sub-nanosecond resolution.  ReadTicks() always reads the raw
+ * counter of the selected backend for windows such as work_start/end.
+ */
+
+#if defined(CLOCK_MONOTONIC_RAW)
+#define NP_CLOCK CLOCK_MONOTONIC_RAW
+#else
+#define NP_CLOCK CLOCK_MONOTONIC
+#endif
+
+double timer_overhead = 0.0;
+
+static int    timer_backend = TIMER_MONO;
+static double tick_sec = 1.0e-9;       /* Seconds per tick            */
+static unsigned long long tick_base;   /* Ticks at TimerInit()        */
+
+static unsigned long long ReadClockNs()
+{
+    struct timespec ts;
+
+    clock_gettime(NP_CLOCK, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Read the cycle counter.  rdtscp waits for earlier instructions to
+ * finish and the lfence keeps later ones from starting early, so the
+ * read is not reordered into or out of the timed region.  rdtscp also
+ * loads the processor id into ecx, named so for both i386 and x86_64.
+ */
+static unsigned long long ReadCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int lo, hi;
+
+    asm volatile("rdtscp\n\t"
+                 "lfence"
+                 : "=a"(lo), "=d"(hi)
+                 :
+                 : "ecx", "memory");
+    return ((unsigned long long)hi << 32) | lo;
+#elif defined(__aarch64__)
+    unsigned long long cnt;
+
+    asm volatile("isb\n\t"
+                 "mrs %0, cntvct_el0"
+                 : "=r"(cnt)
+                 :
+                 : "memory");
+    return cnt;
+#else
+    return ReadClockNs();
+#endif
+}
+
+/* Is there a cycle counter that ticks at a constant rate, even across
+ * frequency changes and idle states?
+ */
+static int HaveInvariantCounter()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    FILE *fd;
+    char line[4096];
+    int ok = 0;
+
+    if ((fd = fopen("/proc/cpuinfo", "r")) == NULL) return 0;
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        if (!strncmp(line, "flags", 5)) {
+            ok = strstr(line, " constant_tsc") && strstr(line, " nonstop_tsc");
+            break;
+        }
+    }
+    fclose(fd);
+    return ok;
+#elif defined(__aarch64__)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Ticks per second of the cycle counter */
+static double CounterFrequency()
+{
+#if defined(__aarch64__)
+    unsigned long long freq;
+
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return (double)freq;
+#else
+    unsigned long long c0, c1, ns0, ns1;
+    double hz, best = 0.0;
+    int i;
+
+    /* Compare against the monotonic clock over 20 ms, a few times, and
+     * keep the estimate from the least disturbed (shortest) bracket.
+     */
+    for (i = 0; i < 3; i++) {
+        ns0 = ReadClockNs();
+        c0  = ReadCycles();
+        do {
+            ns1 = ReadClockNs();
+        } while (ns1 - ns0 < 20000000ULL);
+        c1  = ReadCycles();
+        hz = (c1 - c0) / ((ns1 - ns0) * 1.0e-9);
+        if (best == 0.0 || hz < best) best = hz;
+    }
+    return best;
+#endif
+}
+
+void TimerInit(int backend)
+{
+    struct timespec res;
+    double t0;
+    int i;
+
+    if (backend == TIMER_TSC && !HaveInvariantCounter()) {
+        fprintf(stderr, "No invariant cycle counter found, "
+                "using the monotonic clock instead\n");
+        backend = TIMER_MONO;
+    }
+
+    timer_backend = backend;
+
+    if (backend == TIMER_TSC) {
+        tick_sec  = 1.0 / CounterFrequency();
+        tick_base = ReadCycles();
+        printf("Using the cycle counter timer at %.3f MHz\n", 1.0e-6 / tick_sec);
+    } else {
+        tick_sec  = 1.0e-9;
+        tick_base = ReadClockNs();
+        clock_getres(NP_CLOCK, &res);
+        printf("Using the monotonic clock timer, resolution %ld ns\n",
+               (long)res.tv_nsec);
+    }
+
+    /* Measure the cost of a When() call so it can be taken back out of
+     * timed intervals, which each include one call.
+     */
+    timer_overhead = 0.0;
+    When();
+    t0 = When();
+    for (i = 0; i < 10000; i++)
+        When();
+    timer_overhead = (When() - t0) / 10001;
+    printf("Timer overhead is %.1f ns per call\n\n", timer_overhead * 1.0e9);
+}
+
+unsigned long long ReadTicks()
+{
+    return timer_backend == TIMER_TSC ? ReadCycles() : ReadClockNs();
+}
+
+double TicksToSec(unsigned long long ticks)
+{
+    return ticks * tick_sec;
+}
+
+/* Return the current time in seconds, using a double precision number.      */
+double When()
+{
+    return TicksToSec(ReadTicks() - tick_base);
+}
+
+/* Histogram bucket of a value in nanoseconds.  Values below 2*HIST_SUB
+ * map straight to buckets; above that, each octave keeps HIST_SUB buckets.
+ */
+static int HistIndex(unsigned long long ns)
+{
+    int shift = 0;
+
+    while ((ns >> shift) >= 2*HIST_SUB)
+        shift++;
+
+    return shift*HIST_SUB + (int)(ns >> shift);
+}
+
+/* Midpoint of a histogram bucket, in seconds */
+static double HistValue(int idx)
+{
+    int shift = (idx < 2*HIST_SUB) ? 0 : idx/HIST_SUB - 1;
+    unsigned long long lo = (unsigned long long)(idx - shift*HIST_SUB) << shift;
+
+    return (lo + ((1ULL << shift) - 1) / 2.0) * 1.0e-9;
+}
+
+void HistReset(Hist *h)
+{
+    memset(h, 0, sizeof(Hist));
+}
+
+/* Record one latency t, in seconds */
+void HistAdd(Hist *h, double t)
+{
+    int idx;
+
+    if (t < 0.0) t = 0.0;
+    idx = HistIndex((unsigned long long)(t * 1.0e9 + 0.5));
+    if (idx >= HIST_NBINS) idx = HIST_NBINS - 1;
+
+    h->count[idx]++;
+    h->total++;
+    h->sum   += t;
+    h->sumsq += t*t;
+    h->max    = MAX(h->max, t);
+}
+
+/* Return the latency at percentile pct (0-100), in seconds */
+double HistPercentile(Hist *h, double pct)
+{
+    long long rank, seen = 0;
+    int i;
+
+    if (h->total == 0) return 0.0;
+
+    rank = (long long)(pct / 100.0 * h->total + 0.5);
+    rank = MAX(rank, 1);
+    rank = MIN(rank, h->total);
+
+    for (i = 0; i < HIST_NBINS; i++) {
+        seen += h->count[i];
+        if (seen >= rank)
+            return MIN(HistValue(i), h->max);
+    }
+    return h->max;
+}
+
+double HistMean(Hist *h)
+{
+    return h->total ? h->sum / h->total : 0.0;
+}
+
+double HistVariance(Hist *h)
+{
+    double mean = HistMean(h);
+
+    if (h->total < 2) return 0.0;
+    return MAX((h->sumsq - h->total*mean*mean) / (h->total - 1), 0.0);
+}
+
+static int CompareDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Find the median of the n values in x and a distribution-free 95%
+ * confidence interval for it from the order statistics.  Returns 0 if
+ * n is too small for the interval to exist, in which case lo and hi are
+ * just the smallest and largest values.
+ */
+int MedianCI(double *x, int n, double *med, double *lo, double *hi)
+{
+    double sorted[MAXTRIALS];
+    int    j, k;
+
+    *med = *lo = *hi = 0.0;
+    if (n < 1) return 0;
+
+    memcpy(sorted, x, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), CompareDouble);
+
+    *med = (n % 2) ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2;
+
+    /* 1-based ranks n/2 -/+ 1.96*sqrt(n)/2 bracket the median */
+    j = (int)floor(n/2.0 - 0.98*sqrt((double)n));
+    k = (int)ceil(1 + n/2.0 + 0.98*sqrt((double)n));
+
+    if (j < 1 || k > n) {
+        *lo = sorted[0];
+        *hi = sorted[n-1];
+        return 0;
+    }
+    *lo = sorted[j-1];
+    *hi = sorted[k-1];
+    return 1;
+}
+
+/* Summarize the time of each of the npts points of the curve over all
+ * loops: mean, median and the 95% confidence interval of the median.
+ * Points a loop did not reach (its time is 0) are left out.
+ */
+void LoopSummary(FILE *out, Data *d, int npts, double *loop_t, int loops)
+{
+    double x[MAXTRIALS], mean, med, lo, hi;
+    int    i, j, k;
+
+    fprintf(out, "\nSummary of %d loops (times in usec):\n", loops);
+    fprintf(out, "%8s %10s %10s %10s %10s %12s %5s\n", "bytes",
+            "mean", "median", "ci_lo", "ci_hi", "Mbps", "loops");
+    for (i = 0; i < npts; i++) {
+        for (j = k = 0, mean = 0.0; j < loops; j++) {
+            if (loop_t[i*loops + j] <= 0.0) continue;
+            x[k++] = loop_t[i*loops + j];
+            mean += loop_t[i*loops + j];
+        }
+        if (k == 0) continue;
+        mean /= k;
+        MedianCI(x, k, &med, &lo, &hi);
+        fprintf(out, "%8d %10.3lf %10.3lf %10.3lf %10.3lf %12.6lf %5d\n",
+                d[i].bits / 8, mean*1.0e6, med*1.0e6, lo*1.0e6, hi*1.0e6,
+                d[i].bits / (med * 1024 * 1024), k);
+    }
+}
+
+/* Allocate the points of a base curve, once for all sessions */
+void BaseAlloc(BaseCurve *b)
+{
+    if (b->t != NULL) return;
+    if ((b->t = (double *)calloc(NSAMP, sizeof(double))) == NULL ||
+        (b->p99 = (double *)calloc(NSAMP, sizeof(double))) == NULL ||
+        (b->cpu = (double *)calloc(NSAMP, sizeof(double))) == NULL ||
+        (b->peer = (double *)calloc(NSAMP, sizeof(double))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+/* Keep the best (least) of a base curve's loops: the first loop sets
+ * it, the later ones can only lower it.
+ */
+static void KeepBest(double *best, int first, double x)
+{
+    if (first || x < *best) *best = x;
+}
+
+/* Set up both sides for the current curve.  Both copy on the first
+ * curve, as usual, and send without copying on the zero-copy one.  The
+ * bulk socket buffer size of a loaded curve and the receive policy of a
+ * polling one are sent by the transmitter.
+ */
+void PassStart(ArgStruct *p, Pass *ps)
+{
+#if defined(ZEROCOPY)
+    p->prot.zerocopy = ps->zerocopy ? ps->zcopt : 0;
+#endif
+#if defined(BULKLOAD)
+    if (ps->load > 0) {
+        if (p->tr)
+            SendRepeat(p, ps->loadbuf[ps->load-1]);
+        else
+            RecvRepeat(p, &ps->loadbuf[ps->load-1]);
+        if (p->tr)
+            fprintf(stderr, "Bulk data streaming with %d byte socket buffers\n",
+                    ps->loadbuf[ps->load-1]);
+    }
+#endif
+#if defined(RXPOLL)
+    if (ps->policy > 0) {
+        if (p->tr)
+            SendRepeat(p, ps->rxpol[ps->policy-1]);
+        else
+            RecvRepeat(p, &ps->rxpol[ps->policy-1]);
+        if (p->tr) {
+            fprintf(stderr, "Receiving ");
+            PrintPolicy(stderr, ps->rxpol[ps->policy-1]);
+            fprintf(stderr, "\n");
+        }
+    }
+    SetRecvPolicy(p, ps->policy ? ps->rxpol[ps->policy-1] : RX_POLICY(RX_BLOCK, 0));
+#endif
+}
+
+/* Move on to the next curve of the run: the window doubles up to its
+ * most, then the incast senders do, then come the bulk loads, the
+ * zero-copy curve and the receive policies.  Returns 0 after the last.
+ */
+int NextPass(Pass *ps)
+{
+    if (ps->window && ps->window < ps->winmax)
+        ps->window = MIN(2*ps->window, ps->winmax);
+    else if (ps->nsend < ps->maxsend)
+        ps->nsend = MIN(2*ps->nsend, ps->maxsend);
+    else if (ps->load < ps->nload)
+        ps->load++;
+    else if (ps->zcopt && !ps->zerocopy)
+        ps->zerocopy = 1;
+    else if (ps->policy < ps->npoll)
+        ps->policy++;
+    else
+        return 0;
+    return 1;
+}
+
+/* Name the current curve, as the heading of its loop summary */
+void PassLabel(FILE *out, Pass *ps)
+{
+    if (ps->window)
+        fprintf(out, "\nWindow of %d messages:", ps->window);
+    if (ps->maxsend)
+        fprintf(out, "\n%d incast senders:", ps->nsend);
+#if defined(BULKLOAD)
+    if (ps->nload) {
+        if (ps->load)
+            fprintf(out, "\nBulk load with %d byte socket buffers:",
+                    ps->loadbuf[ps->load-1]);
+        else
+            fprintf(out, "\nIdle:");
+    }
+#endif
+    if (ps->zcopt)
+        fprintf(out, ps->zerocopy ? "\nZero-copy:" : "\nCopying:");
+#if defined(RXPOLL)
+    if (ps->npoll) {
+        fprintf(out, "\nReceiving ");
+        PrintPolicy(out, ps->policy ? ps->rxpol[ps->policy-1] : RX_POLICY(RX_BLOCK, 0));
+        fprintf(out, ":");
+    }
+#endif
+}
+
+/* Under bulk load, how much the time and the 99th percentile p99 of
+ * point n grow over those of the idle curve, the best of its loops.
+ */
+void CompareLoad(Pass *ps, Data *d, int n, int first, double p99)
+{
+    if (ps->load == 0) {
+        KeepBest(&ps->idle.t[n], first, d->t);
+        KeepBest(&ps->idle.p99[n], first, p99);
+    }
+    if (ps->idle.t[n] > 0.0)
+        d->inflation = d->t / ps->idle.t[n];
+    if (ps->idle.p99[n] > 0.0)
+        d->p99_inflation = p99 / ps->idle.p99[n];
+}
+
+/* Zero-copy: how much longer point n takes, and how much more CPU time
+ * per message it costs, when copying, the best of the copying curve's
+ * loops.  The CPU time both sides save is also given per byte of the
+ * bufflen byte message.
+ */
+void CompareZeroCopy(Pass *ps, Data *d, int n, int first, int bufflen)
+{
+    if (ps->zerocopy == 0) {
+        KeepBest(&ps->copy.t[n], first, d->t);
+        KeepBest(&ps->copy.cpu[n], first, d->cpu_msg);
+        KeepBest(&ps->copy.peer[n], first, d->peer_cpu_msg);
+    }
+    if (ps->copy.t[n] > 0.0)
+        d->zc_speedup = ps->copy.t[n] / d->t;
+    if (ps->copy.cpu[n] > 0.0 && d->cpu_msg > 0.0)
+        d->zc_cpu = ps->copy.cpu[n] / d->cpu_msg;
+    if (ps->copy.peer[n] >= 0.0 && d->peer_cpu_msg >= 0.0)
+        d->zc_saved = (ps->copy.cpu[n] + ps->copy.peer[n] - d->cpu_msg
+                       - d->peer_cpu_msg) / bufflen;
+}
+
+/* Receive policies: how much sooner than blocking in read() the message
+ * of point n arrives, and how much more CPU time per message both sides
+ * spend waiting for it, against the best of the blocking curve's loops.
+ * The policy's latency, energy and CPU time are summed over its points
+ * for PolicySummary(), h holding the latencies of the point.
+ */
+void ComparePolicy(Pass *ps, Data *d, int n, int first, Hist *h)
+{
+    double cpu = MAX(d->cpu_msg, 0.0) + MAX(d->peer_cpu_msg, 0.0);
+
+    if (ps->policy == 0) {
+        KeepBest(&ps->block.t[n], first, d->t);
+        KeepBest(&ps->block.cpu[n], first, cpu);
+    }
+    d->rx_gain = (ps->block.t[n] - d->t) * 1.0e9;
+    d->rx_cpu = cpu - ps->block.cpu[n];
+#if defined(RXPOLL)
+    if (first && n == 0) {
+        memset(ps->rxsum[ps->policy], 0, sizeof(ps->rxsum[ps->policy]));
+        ps->rxpts[ps->policy] = 0;
+    }
+    ps->rxsum[ps->policy][0] += HistPercentile(h, 50.0);
+    ps->rxsum[ps->policy][1] += HistPercentile(h, 99.0);
+    ps->rxsum[ps->policy][2] += d->rx_joules;
+    ps->rxsum[ps->policy][3] += d->rx_cpu;
+    ps->rxsum[ps->policy][4] += d->rx_blocked;
+    ps->rxpts[ps->policy]++;
+#endif
+}
+
+/* The smallest size from which on zero-copy beats copying, in time and
+ * in CPU time per message, over the n points of the zero-copy curve.
+ */
+void ZeroCopySummary(FILE *out, Data *d, int n)
+{
+    int i, j;
+
+    for (j = n, i = n; j > 0 && d[j-1].zc_speedup > 1.0; j--)
+        ;
+    for (; i > 0 && d[i-1].zc_cpu > 1.0; i--)
+        ;
+    if (j < n)
+        fprintf(out, "Zero-copy is faster from %d bytes on", d[j].bits / 8);
+    else
+        fprintf(out, "Zero-copy is never faster");
+    if (i < n)
+        fprintf(out, ", costs less CPU from %d bytes on\n", d[i].bits / 8);
+    else
+        fprintf(out, ", never costs less CPU\n");
+}
+
+#if defined(RXPOLL)
+/* The latency and energy of each receive policy side by side, as means
+ * over its curve's points.
+ */
+void PolicySummary(FILE *out, Pass *ps)
+{
+    int i;
+
+    fprintf(out, "\nReceive policies, means over the points of each curve:\n");
+    for (i = 0; i <= ps->npoll; i++) {
+        if (ps->rxpts[i] == 0)     /* The curve was cut short before a point */
+            fprintf(out, "  no points measured, ");
+        else {
+            fprintf(out, "  p50 %9.2lf p99 %9.2lf usec, ",
+                    ps->rxsum[i][0] / ps->rxpts[i] * 1.0e6,
+                    ps->rxsum[i][1] / ps->rxpts[i] * 1.0e6);
+            if (ps->rxsum[i][2] >= 0.0)
+                fprintf(out, "%9.3lf uJ/msg, ", ps->rxsum[i][2] / ps->rxpts[i] * 1.0e6);
+            else
+                fprintf(out, "energy unknown, ");
+            fprintf(out, "%+9.0lf ns/msg CPU, %3.0lf%% blocked, ",
+                    ps->rxsum[i][3] / ps->rxpts[i], ps->rxsum[i][4] / ps->rxpts[i] * 100.0);
+        }
+        PrintPolicy(out, i ? ps->rxpol[i-1] : RX_POLICY(RX_BLOCK, 0));
+        fprintf(out, "\n");
+    }
+}
+#endif
+
+/* Receive a reply of response bytes, or of the request size if 0 */
+void RecvResponse(ArgStruct *p, int response)
+{
+    int len = p->bufflen;
+
+    if (response) p->bufflen = response;
+    RecvData(p);
+    p->bufflen = len;
+}
+
+/* Send a reply of response bytes, or of the request size if 0 */
+void SendResponse(ArgStruct *p, int response)
+{
+    int len = p->bufflen;
+
+    if (response) p->bufflen = response;
+    SendData(p);
+    p->bufflen = len;
+}
+
+/* Emulate the server working on a request by spinning for a fixed time,
+ * or for one drawn from an exponential distribution with that mean.
+ */
+void ServiceTime(double mean, int exponential)
+{
+    double until;
+
+    if (mean <= 0.0) return;
+    until = When() + (exponential ? -mean * log(1.0 - drand48()) : mean);
+    while (When() < until)
+        ;
+}
+
+/* Add a message to a trace, growing it as needed */
+static void TraceAdd(TraceRec **trace, int *n, int size, int dir, double gap)
+{
+    if ((*n & 1023) == 0 &&
+        (*trace = (TraceRec *)realloc(*trace, (*n + 1024) * sizeof(TraceRec))) == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    (*trace)[*n].size = size;
+    (*trace)[*n].dir  = dir;
+    (*trace)[*n].gap  = gap;
+    (*n)++;
+}
+
+/* Read a 16 or 32-bit field of a pcap file in its byte order */
+static unsigned int PcapField(unsigned char *b, int len, int swap)
+{
+    if (len == 2)
+        return swap ? (unsigned int)(b[1] << 8 | b[0]) : (unsigned int)(b[0] << 8 | b[1]);
+    return swap ? (unsigned int)b[3] << 24 | b[2] << 16 | b[1] << 8 | b[0]
+                : (unsigned int)b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+}
+
+/* Extract the messages of the first TCP flow in a pcap file.  The side
+ * that sends the first data is the transmitter, and consecutive segments
+ * in the same direction are joined into one message.  Ethernet (with
+ * VLAN tags), Linux cooked (v1 and v2) and raw IP captures of IPv4 and
+ * IPv6 without extension headers are understood.
+ */
+static int ReadPcap(FILE *fd, unsigned char *hdr, TraceRec **trace)
+{
+    unsigned char pkt[65536 + 64], *ip, *tcp, flow[32], key[36],
+                  src[18], dst[18];
+    unsigned int  magic, link, caplen, off, iplen, hlen, etype;
+    int           swap, nsec, n = 0, dir, last = -1, keylen = 0, len;
+    double        ts, tlast = 0.0;
+
+    magic = PcapField(hdr, 4, 0);
+    swap  = (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1);
+    nsec  = (magic == 0xa1b23c4d || magic == 0x4d3cb2a1);
+    link  = PcapField(hdr + 20, 4, swap);
+
+    while (fread(pkt, 1, 16, fd) == 16) {
+        ts = PcapField(pkt, 4, swap) +
+             PcapField(pkt + 4, 4, swap) * (nsec ? 1.0e-9 : 1.0e-6);
+        caplen = PcapField(pkt + 8, 4, swap);
+        if (caplen > sizeof(pkt) || fread(pkt, 1, caplen, fd) != caplen) break;
+
+        /* Find the IP header */
+        switch (link) {
+        case 1:   off = 14; etype = pkt[12] << 8 | pkt[13];     /* Ethernet */
+                  while (etype == 0x8100 && off + 4 <= caplen) {
+                      etype = pkt[off+2] << 8 | pkt[off+3];
+                      off += 4;
+                  }
+                  break;
+        case 113: off = 16; etype = pkt[14] << 8 | pkt[15]; break; /* SLL  */
+        case 276: off = 20; etype = pkt[0] << 8 | pkt[1];   break; /* SLL2 */
+        case 12:
+        case 101: off = 0;                                       /* Raw IP */
+                  etype = (caplen > 0 && pkt[0] >> 4 == 6) ? 0x86dd : 0x0800;
+                  break;
+        default:  fprintf(stderr, "Unsupported pcap link type %u\n", link);
+                  return -1;
+        }
+        if (off + 40 > caplen) continue;
+        ip = pkt + off;
+
+        /* Find the TCP header and payload length, taken from the IP
+         * header so that a short snaplen still gives the right size.
+         */
+        if (etype == 0x0800 && ip[9] == 6) {
+            hlen  = (ip[0] & 0x0f) * 4;
+            iplen = ip[2] << 8 | ip[3];
+            memcpy(flow, ip + 12, 4);  memcpy(flow + 4, ip + 16, 4);
+            keylen = 4;
+        } else if (etype == 0x86dd && ip[6] == 6) {
+            hlen  = 40;
+            iplen = 40 + (ip[4] << 8 | ip[5]);
+            memcpy(flow, ip + 8, 16);  memcpy(flow + 16, ip + 24, 16);
+            keylen = 16;
+        } else
+            continue;
+        if (off + hlen + 20 > caplen) continue;
+        tcp = ip + hlen;
+        len = (int)iplen - (int)hlen - (tcp[12] >> 4) * 4;
+        if (len <= 0) continue;
+
+        /* Ports follow the addresses; the first data packet sets the
+         * flow and the transmitter's side of it.
+         */
+        memcpy(src, flow, keylen);           memcpy(src + keylen, tcp, 2);
+        memcpy(dst, flow + keylen, keylen);  memcpy(dst + keylen, tcp + 2, 2);
+        if (last < 0) {
+            memcpy(key, src, keylen + 2);
+            memcpy(key + 18, dst, keylen + 2);
+        }
+        if (!memcmp(src, key, keylen + 2) && !memcmp(dst, key + 18, keylen + 2))
+            dir = TRACE_C2S;
+        else if (!memcmp(dst, key, keylen + 2) && !memcmp(src, key + 18, keylen + 2))
+            dir = TRACE_S2C;
+        else
+            continue;                         /* Another flow */
+
+        if (dir == last)
+            (*trace)[n-1].size += len;
+        else {
+            TraceAdd(trace, &n, len, dir, n ? ts - tlast : 0.0);
+            tlast = ts;
+            last = dir;
+        }
+    }
+    return n;
+}
+
+/* Read a trace for replay, either a pcap file or lines of "size gap
+ * direction" with the gap in microseconds and the direction > for the
+ * transmitter or < for the receiver.  Returns the number of messages.
+ */
+int ReadTrace(char *file, TraceRec **trace)
+{
+    FILE          *fd;
+    char          line[256], d;
+    unsigned char hdr[24];
+    unsigned int  magic;
+    int           n = 0, size;
+    double        gap;
+
+    *trace = NULL;
+    if ((fd = fopen(file, "r")) == NULL) {
+        fprintf(stderr, "Can't open trace %s\n", file);
+        exit(-1);
+    }
+
+    if (fread(hdr, 1, 24, fd) == 24) {
+        magic = PcapField(hdr, 4, 0);
+        if (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 ||
+            magic == 0xa1b23c4d || magic == 0x4d3cb2a1) {
+            n = ReadPcap(fd, hdr, trace);
+            fclose(fd);
+            return n;
+        }
+    }
+
+    rewind(fd);
+    while (fgets(line, sizeof(line), fd) != NULL) {
+        if (line[0] == '#' || sscanf(line, "%d %lf %c", &size, &gap, &d) != 3)
+            continue;
+        if (size > 0)
+            TraceAdd(trace, &n, size, d == '<' ? TRACE_S2C : TRACE_C2S, gap * 1.0e-6);
+    }
+    fclose(fd);
+    return n;
+}
+
+/* Send the trace to the receiver, after the configuration, as a size,
+ * a direction and the gap in nanoseconds for each message.  The gap is
+ * 64 bits, high word first like SendTime(), so long idle periods fit.
+ */
+void SendTrace(ArgStruct *p, TraceRec *trace, int n)
+{
+    int i;
+    unsigned long long gap;
+
+    for (i = 0; i < n; i++) {
+        gap = (unsigned long long)llround(trace[i].gap * 1.0e9);
+        SendRepeat(p, trace[i].size);
+        SendRepeat(p, trace[i].dir);
+        SendRepeat(p, (int)(unsigned int)(gap >> 32));
+        SendRepeat(p, (int)(unsigned int)gap);
+    }
+}
+
+/* Receive the n messages of the transmitter's trace, replacing any trace
+ * of an earlier session.  Returns n.
+ */
+int RecvTrace(ArgStruct *p, TraceRec **trace, int n)
+{
+    int i, size, dir, hi, lo;
+
+    free(*trace);
+    *trace = NULL;
+    for (i = 0; i < n; ) {
+        RecvRepeat(p, &size);
+        RecvRepeat(p, &dir);
+        RecvRepeat(p, &hi);
+        RecvRepeat(p, &lo);
+        TraceAdd(trace, &i, size, dir,
+                 ((unsigned long long)(unsigned int)hi << 32 |
+                  (unsigned int)lo) * 1.0e-9);
+    }
+    return n;
+}
+
+/* Replay a trace once.  Each side sends its own messages when they are
+ * due, the gaps being kept from the start of the replay, and receives
+ * the others'.  lat, if given, gets how long after it was due each
+ * message was sent or fully received.
+ */
+void Replay(ArgStruct *p, TraceRec *trace, int n, double *lat)
+{
+    double due, wait;
+    struct timespec ts;
+    int    k, len = p->bufflen;
+
+    due = When();
+    for (k = 0; k < n; k++) {
+        due += trace[k].gap;
+        p->bufflen = trace[k].size;
+        if ((trace[k].dir == TRACE_C2S) == (p->tr != 0)) {
+            while ((wait = due - When()) > 0.0) {
+                if (wait > 100.0e-6) {
+                    wait -= 50.0e-6;
+                    ts.tv_sec  = (time_t)wait;
+                    ts.tv_nsec = (long)((wait - ts.tv_sec) * 1.0e9);
+                    nanosleep(&ts, NULL);
+                }
+            }
+            SendData(p);
+        } else
+            RecvData(p);
+        if (lat != NULL)
+            lat[k] = When() - due;
+    }
+    p->bufflen = len;
+}
+
+/* Draw n message sizes from the distribution in spec into a new table,
+ * using erand48() seeded with seed so a run can be repeated:
+ *   uniform:min,max        sizes equally likely from min to max
+ *   bimodal:a,b,p          size a with probability p, otherwise b
+ *   lognormal:median,sigma sigma of the log of the size
+ *   cdf:file               lines of "size cumulative_probability"
+ * Returns n, or 0 if spec can't be used.
+ */
+int DrawSizes(char *spec, int seed, int n, int **sizes)
+{
+    unsigned short xs[3];
+    char   kind[16], file[255], line[256];
+    double a = 0.0, b = 0.0, c = 0.0, u, *cp = NULL;
+    int    i, k, ncdf = 0, *cs = NULL, size;
+    FILE   *fd;
+
+    if (sscanf(spec, "%15[^:]:%lf,%lf,%lf", kind, &a, &b, &c) < 1) {
+        fprintf(stderr, "Bad size distribution %s\n", spec);
+        return 0;
+    }
+
+    if (!strcmp(kind, "cdf")) {
+        strncpy(file, strchr(spec, ':') ? strchr(spec, ':') + 1 : "", 254);
+        file[254] = '\0';
+        if ((fd = fopen(file, "r")) == NULL) {
+            fprintf(stderr, "Can't open size distribution %s\n", file);
+            return 0;
+        }
+        while (fgets(line, sizeof(line), fd) != NULL) {
+            if (sscanf(line, "%d %lf", &size, &u) != 2 || size < 1)
+                continue;
+            if (ncdf % 256 == 0 &&
+                ((cs = (int *)realloc(cs, (ncdf + 256) * sizeof(int))) == NULL ||
+                 (cp = (double *)realloc(cp, (ncdf + 256) * sizeof(double))) == NULL)) {
+                perror("malloc");
+                exit(1);
+            }
+            cs[ncdf] = size;
+            cp[ncdf++] = u;
+        }
+        fclose(fd);
+        if (ncdf == 0 || cp[ncdf-1] <= 0.0) {
+            fprintf(stderr, "No sizes found in %s\n", file);
+            return 0;
+        }
+    } else if (!((!strcmp(kind, "uniform") && a >= 1.0 && b >= a) ||
+                 (!strcmp(kind, "bimodal") && a >= 1.0 && b >= 1.0 &&
+                  c >= 0.0 && c <= 1.0) ||
+                 (!strcmp(kind, "lognormal") && a >= 1.0 && b >= 0.0))) {
+        fprintf(stderr, "Bad size distribution %s\n", spec);
+        return 0;
+    }
+
+    if ((*sizes = (int *)realloc(*sizes, n * sizeof(int))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    xs[0] = 0x330e;
+    xs[1] = seed & 0xffff;
+    xs[2] = (seed >> 16) & 0xffff;
+
+    for (i = 0; i < n; i++) {
+        u = erand48(xs);
+        switch (kind[0]) {
+        case 'u': size = (int)(a + u * (b - a + 1.0));            break;
+        case 'b': size = (int)(u < c ? a : b);                     break;
+        case 'l': /* Box-Muller for a standard normal deviate */
+                  size = (int)llround(a * exp(b * sqrt(-2.0 * log(1.0 - u))
+                                                * cos(2.0 * M_PI * erand48(xs))));
+                  break;
+        default:  for (k = 0; k < ncdf-1 && cp[k] < u * cp[ncdf-1]; k++)
+                      ;
+                  size = cs[k];
+                  break;
+        }
+        (*sizes)[i] = MAX(size, 1);
+    }
 
-       /* t is the 1-directional trasmission time */
-       t = (When() - t0)/ nrepeat;
-       t /= 2; /* Normal ping-pong */
-       Reset(&args);
+    free(cs);
+    free(cp);
+    return n;
+}
+
+/* Send the size table to the receiver, after the configuration */
+void SendSizes(ArgStruct *p, int *sizes, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        SendRepeat(p, sizes[i]);
+}
 
-/* NOTE: NetPIPE does each data point TRIALS times, bouncing the message
- * nrepeats times for each trial, then reports the lowest of the TRIALS
- * times.  -Dave Turner
+/* Receive the transmitter's n sizes, replacing the table of an earlier
+ * session.  Returns n.
  */
-       bwdata[n].t = MIN(bwdata[n].t, t);
-     }
-   }
-   else if( args.rcv )
-   {
-     /*
-       This is the receiver: receive the block TRIALS times, and
-       if we are not streaming, send the block back to the
-       sender.
+int RecvSizes(ArgStruct *p, int **sizes, int n)
+{
+    int i;
+
+    if (n > 0 && (*sizes = (int *)realloc(*sizes, n * sizeof(int))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        RecvRepeat(p, &(*sizes)[i]);
+    return n;
+}
+
+/* Power-of-2 bucket of a message size: bucket b holds 2^b to 2^(b+1)-1 */
+int SizeBucket(int size)
+{
+    int b = 0;
+
+    while (b < NSIZEBKT-1 && (size >> (b+1)) > 0)
+        b++;
+    return b;
+}
+
+#if defined(OPENLOOP)
+
+/* State shared by the open-loop sender and receiver threads.  Each works
+ * on its own copy of the ArgStruct, with its own buffer, over the same
+ * connection.
+ */
+typedef struct openloop
+{
+    ArgStruct sargs, rargs;
+    int       n;        /* Requests in this run                       */
+    double    *sched;   /* Intended send time of each request         */
+    Hist      *h;
+} OpenLoopState;
+
+/* Send each request at its intended time, whether or not earlier replies
+ * are back.  Sleep while the next one is far off and spin for the rest.
+ */
+static void *OpenLoopSend(void *arg)
+{
+    OpenLoopState *o = (OpenLoopState *)arg;
+    struct timespec ts;
+    double wait;
+    int k;
+
+    for (k = 0; k < o->n; k++) {
+        while ((wait = o->sched[k] - When()) > 0.0) {
+            if (wait > 100.0e-6) {
+                wait -= 50.0e-6;
+                ts.tv_sec  = (time_t)wait;
+                ts.tv_nsec = (long)((wait - ts.tv_sec) * 1.0e9);
+                nanosleep(&ts, NULL);
+            }
+        }
+        memcpy(o->sargs.s_ptr, &k, sizeof(int));
+        SendData(&o->sargs);
+    }
+    return NULL;
+}
+
+/* Match each reply to its request by sequence number.  Latency runs from
+ * the request's intended send time, so a sender that falls behind under
+ * load is charged for the wait (no coordinated omission).
+ */
+static void *OpenLoopRecv(void *arg)
+{
+    OpenLoopState *o = (OpenLoopState *)arg;
+    int k, seq;
+
+    for (k = 0; k < o->n; k++) {
+        RecvData(&o->rargs);
+        memcpy(&seq, o->rargs.r_ptr, sizeof(int));
+        if (seq >= 0 && seq < o->n)
+            HistAdd(o->h, When() - o->sched[seq] - timer_overhead);
+    }
+    return NULL;
+}
+
+/* Offer n requests at rate per second, evenly spaced or with Poisson
+ * arrivals, recording the latency of each in h.  Replies are response
+ * bytes, or the request size if 0.
+ */
+void OpenLoop(ArgStruct *p, int n, double rate, int poisson, int response,
+              Hist *h)
+{
+    OpenLoopState o;
+    pthread_t     st, rt;
+    int           k;
+
+    o.sargs = o.rargs = *p;
+    if (response) o.rargs.bufflen = response;
+    o.n = n;
+    o.h = h;
+    if ((o.sched = (double *)malloc(n * sizeof(double))) == NULL ||
+        (o.sargs.s_ptr = (char *)malloc(p->bufflen)) == NULL ||
+        (o.rargs.r_ptr = (char *)malloc(o.rargs.bufflen)) == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    memset(o.sargs.s_ptr, 0, p->bufflen);
+
+    o.sched[0] = When() + 1.0e-3;   /* Time for the threads to start */
+    for (k = 1; k < n; k++)
+        o.sched[k] = o.sched[k-1] +
+                     (poisson ? -log(1.0 - drand48()) : 1.0) / rate;
+
+    if (pthread_create(&rt, NULL, OpenLoopRecv, &o) != 0 ||
+        pthread_create(&st, NULL, OpenLoopSend, &o) != 0)
+    {
+        perror("pthread_create");
+        exit(1);
+    }
+    pthread_join(st, NULL);
+    pthread_join(rt, NULL);
+
+    /* Count what the threads did on their copies as done through p.  Only
+     * the sender sends, so its zero-copy sequence numbers carry on.
      */
-     int cpu_model=detect_cpu();
-     int core=0;
-     detect_packages();
-     int result=rapl_msr(core,cpu_model);
-     
-     for (i = 0; i < (integCheck ? 1 : TRIALS); i++)
-     {
-       /* Flush the cache using the dummy buffer */
-       if (!args.cache)
-	 flushcache(memcache, MEMSIZE/sizeof(int));
+    if (p->syscalls >= 0)
+        p->syscalls = o.sargs.syscalls + o.rargs.syscalls - p->syscalls;
+#if defined(ZEROCOPY)
+    p->prot.zc_sent   = o.sargs.prot.zc_sent;
+    p->prot.zc_done   = o.sargs.prot.zc_done;
+    p->prot.zc_copied = o.sargs.prot.zc_copied;
+#endif
+#if defined(ZC_RECV)
+    p->prot.zc_rbytes = o.rargs.prot.zc_rbytes;
+    p->prot.zc_mapped = o.rargs.prot.zc_mapped;
+#endif
+    p->rxcalls  = o.rargs.rxcalls;
+    p->rxblocks = o.rargs.rxblocks;
 
-       Sync(&args);
+    free(o.sched);
+    free(o.sargs.s_ptr);
+    free(o.rargs.r_ptr);
+}
 
-       t0 = When();
-       
-       for (j = 0; j < nrepeat; j++)
-       {
-	 RecvData(&args);
-	 if(j == 0) {
-	   work_start = rdtsc();
-	   pk0_start = read_pkg_energy(0);
-	   pk1_start = read_pkg_energy(1);
-	   
-	   //pk0_joules = read_package(0);
-	   //pk1_joules = read_package(1);	   
-	 }
-	 if(j == nrepeat-1) {
-	   work_end = rdtsc();
-
-	   pk0_joules = calculate_energy(pk0_start, 0);
-	   pk1_joules = calculate_energy(pk1_start, 1);
-	   //pk0_joules = read_package(0) - pk0_joules;
-	   //pk1_joules = read_package(1) - pk1_joules;
-	 }
-	 
-	 if (!args.cache)
-	 { 
-	   AdvanceRecvPtr(&args, len_buf_align);
-	 }
-                        
-	 if (!streamopt)
-	 {
-	   SendData(&args);
-	   if(!args.cache) 
-	     AdvanceSendPtr(&args, len_buf_align);
-	 }
-       }
-       work_end = rdtsc();
-       t = (When() - t0)/ nrepeat;       
-       
-       t /= 2; /* Normal ping-pong */
-       Reset(&args);
-       bwdata[n].t = MIN(bwdata[n].t, t);
-     }
-   }   
+#endif
 
-   /* Streaming mode doesn't really calculate correct latencies
-    * for small message sizes, and on some nics we can get
-    * zero second latency after doing the math.  Protect against
-    * this.
-    */
-   if(bwdata[n].t == 0.0) {
-     bwdata[n].t = 0.000001;
-   }
-            
-   tlast = bwdata[n].t;
-   bwdata[n].bits = args.bufflen * CHARSIZE * (1+args.bidir);
-   bwdata[n].bps = bwdata[n].bits / (bwdata[n].t * 1024 * 1024);
-   bwdata[n].repeat = nrepeat;
+#if defined(MULTISTREAM)
 
-   tend = When();
-   if (args.tr)
-   {
-     if(integCheck) {
-       fprintf(out,"%8d %d", bwdata[n].bits / 8, nrepeat);
+/* Open n more connections next to the first, stream k on port p->port+1+k
+ * with its own ArgStruct.  The receiver accepts them in order, so the
+ * transmitter retries each until the receiver listens for it.
+ */
+ArgStruct *OpenStreams(ArgStruct *p, int n)
+{
+    ArgStruct *st;
+    int       k;
+
+    if ((st = (ArgStruct *)malloc(n * sizeof(ArgStruct))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (k = 0; k < n; k++) {
+        st[k] = *p;
+        st[k].port = p->port + 1 + k;
+        st[k].reset_conn = 0;
+        st[k].connect_retry = p->tr;
+        Setup(&st[k]);
+    }
+    return st;
+}
 
-     } else {
-       fprintf(out,"%8d %lf %.8lf %.6lf",
-	       bwdata[n].bits / 8, bwdata[n].bps, bwdata[n].t, tend-tstart);
+void CloseStreams(ArgStruct *st, int n)
+{
+    int k;
 
-     }
-     fprintf(out, "\n");
-     fflush(out);
-   } else {
-     printf("SERVER_WORKLOAD_PERIOD: %lu %lu %.6f %.6f\n", work_start, work_end,
-	    pk0_joules, pk1_joules);
-   }
-    
-   /* Free using original buffer addresses since we may have aligned
-      r_buff and s_buff */
-   if (args.cache)
-     FreeBuff(args.r_buff_orig, NULL);
-            
-   if ( args.tr ) {
-     if(integCheck) {
-       fprintf(stderr, " Integrity check passed\n");
+    for (k = 0; k < n; k++)
+        CleanUp(&st[k]);
+    free(st);
+}
 
-     } else {
-       fprintf(stderr," %8.2lf Mbps in %10.2lf usec, %.6lf sec total\n", 
-	       bwdata[n].bps, tlast*1.0e6, tend-tstart);
-     }
-   }
- 
-   /* Free using original buffer addresses since we may have aligned
-      r_buff and s_buff */
+#if defined(BULKLOAD)
 
-   if (!args.cache) {
-        FreeBuff(args.s_buff_orig, args.r_buff_orig);
-   }
-   if (args.tr) fclose(out);
-         
-    CleanUp(&args);
-    return 0;
+static void *BulkRun(void *arg)
+{
+    BulkLoad *b = (BulkLoad *)arg;
+    ssize_t  r;
+
+    while (!b->stop) {
+        r = b->a.tr ? write(b->a.commfd, b->buf, BULKCHUNK)
+                    : read(b->a.commfd, b->buf, BULKCHUNK);
+        if (r <= 0) break;
+        b->bytes += r;
+    }
+    return NULL;
+}
+
+/* Open the bulk connection next to the first one, with socket buffers of
+ * sockbuf bytes, or the system's if 0, and start streaming on it.
+ */
+BulkLoad *BulkStart(ArgStruct *p, int sockbuf)
+{
+    BulkLoad  *b;
+    ArgStruct a = *p, *st;
+
+    a.prot.sndbufsz = a.prot.rcvbufsz = sockbuf;
+    a.nfan = 0;
+    st = OpenStreams(&a, 1);
+    if ((b = (BulkLoad *)malloc(sizeof(BulkLoad))) == NULL ||
+        (b->buf = (char *)malloc(BULKCHUNK)) == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    b->a = st[0];
+    free(st);
+    memset(b->buf, 0, BULKCHUNK);
+    b->stop = 0;
+    b->bytes = 0;
+    if (pthread_create(&b->th, NULL, BulkRun, b) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    return b;
 }
 
+/* The transmitter stops writing and shuts its side down, which ends the
+ * receiver's reads, then waits for the receiver to close the connection
+ * so the receiver's listening port is free for the next one.
+ */
+void BulkStop(BulkLoad *b)
+{
+    char c;
+
+    b->stop = 1;
+    pthread_join(b->th, NULL);
+    if (b->a.tr) {
+        shutdown(b->a.commfd, SHUT_WR);
+        while (read(b->a.commfd, &c, 1) > 0)
+            ;
+    } else {
+        close(b->a.servicefd);
+    }
+    close(b->a.commfd);
+    free(b->buf);
+    free(b);
+}
 
-/* Return the current time in seconds, using a double precision number.      */
-double When()
+#endif
+
+/* One stream's share of a MultiStream() trial */
+typedef struct streamstate
+{
+    ArgStruct *a;
+    int       k, nrepeat, stream, response, service_exp, pin;
+    double    service, t;
+    double    *lat;     /* Time of each incast round, or NULL         */
+    pthread_barrier_t *go;
+} StreamState;
+
+/* Run the calling stream thread on core k */
+static void PinStream(int k)
+{
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(k % (int)sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+/* Run the trial of one stream: the transmitter sends nrepeat messages,
+ * each answered by the receiver unless streaming, in which case the
+ * receiver acknowledges the last one.  The transmitter's time is kept.
+ */
+static void *StreamRun(void *arg)
+{
+    StreamState *ss = (StreamState *)arg;
+    ArgStruct   *a = ss->a;
+    double      t0;
+    int         j, ack;
+
+    if (ss->pin) PinStream(ss->k);
+    if (a->tr) {
+        pthread_barrier_wait(ss->go);
+        t0 = When();
+        for (j = 0; j < ss->nrepeat; j++) {
+            SendData(a);
+            if (!ss->stream)
+                RecvResponse(a, ss->response);
+        }
+        if (ss->stream)
+            RecvRepeat(a, &ack);
+        ss->t = When() - t0 - timer_overhead;
+    } else {
+        for (j = 0; j < ss->nrepeat; j++) {
+            RecvData(a);
+            if (!ss->stream) {
+                ServiceTime(ss->service, ss->service_exp);
+                SendResponse(a, ss->response);
+            }
+        }
+        if (ss->stream)
+            SendRepeat(a, ss->nrepeat);
+    }
+    return NULL;
+}
+
+/* Run one trial of nrepeat messages of bufflen bytes on all n streams at
+ * once, each from its own thread with its own buffer, the threads pinned
+ * to cores 0 to n-1 if pin is set.  On the transmitter, t gets the time
+ * each stream took.
+ */
+void MultiStream(ArgStruct *st, int n, int bufflen, int nrepeat, int stream,
+                 int response, double service, int service_exp, int pin,
+                 double *t)
+{
+    StreamState       *ss;
+    pthread_t         *th;
+    pthread_barrier_t go;
+    int               k, len;
+
+    if ((ss = (StreamState *)malloc(n * sizeof(StreamState))) == NULL ||
+        (th = (pthread_t *)malloc(n * sizeof(pthread_t))) == NULL)
+    {
+        perror("malloc");
+        exit(1);
+    }
+    pthread_barrier_init(&go, NULL, n);
+    for (k = 0; k < n; k++) {
+        st[k].bufflen = bufflen;
+        len = MAX(bufflen, response);
+        if ((st[k].s_ptr = st[k].r_ptr = (char *)malloc(len)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        memset(st[k].s_ptr, 0, len);
+        ss[k].a = &st[k];
+        ss[k].k = k;
+        ss[k].nrepeat = nrepeat;
+        ss[k].stream = stream;
+        ss[k].response = response;
+        ss[k].service = service;
+        ss[k].service_exp = service_exp;
+        ss[k].pin = pin;
+        ss[k].go = &go;
+    }
+    for (k = 0; k < n; k++)
+        if (pthread_create(&th[k], NULL, StreamRun, &ss[k]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    for (k = 0; k < n; k++) {
+        pthread_join(th[k], NULL);
+        if (t != NULL) t[k] = ss[k].t;
+        free(st[k].s_ptr);
+    }
+    pthread_barrier_destroy(&go);
+    free(ss);
+    free(th);
+}
+
+#if defined(INCAST)
+
+/* One incast sender: each round, start with the others, send one block
+ * and wait for the receiver to acknowledge the whole round.
+ */
+static void *IncastSend(void *arg)
+{
+    StreamState *ss = (StreamState *)arg;
+    double      t0;
+    int         j, ack;
+
+    if (ss->pin) PinStream(ss->k);
+    for (j = 0; j < ss->nrepeat; j++) {
+        pthread_barrier_wait(ss->go);
+        t0 = When();
+        SendData(ss->a);
+        RecvRepeat(ss->a, &ack);
+        if (ss->lat != NULL)
+            ss->lat[j] = When() - t0 - timer_overhead;
+    }
+    return NULL;
+}
+
+/* Run nrepeat incast rounds over the n streams.  The transmitter's n
+ * threads send a block of bufflen bytes each at the same time, and
+ * lat, if given, gets the time of each round until the last sender was
+ * acknowledged.  The receiver serves all connections from one thread
+ * with epoll, acknowledging every sender once all blocks are in; comp,
+ * if given, gets each sender's mean completion time from the first byte
+ * of the round.  Returns the receiver's total time in rounds.
+ */
+double Incast(ArgStruct *st, int n, int bufflen, int nrepeat, int pin,
+              double *lat, double *comp)
+{
+    StreamState        *ss;
+    pthread_t          *th;
+    pthread_barrier_t  go;
+    struct epoll_event ev, *evs;
+    int                epfd, j, k, e, nev, left, *got;
+    ssize_t            r;
+    double             t0, t, busy = 0.0, *tl = NULL;
+
+    for (k = 0; k < n; k++) {
+        st[k].bufflen = bufflen;
+        if ((st[k].s_ptr = st[k].r_ptr = (char *)malloc(bufflen)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        memset(st[k].s_ptr, 0, bufflen);
+    }
+
+    if (st[0].tr) {
+        if ((ss = (StreamState *)malloc(n * sizeof(StreamState))) == NULL ||
+            (th = (pthread_t *)malloc(n * sizeof(pthread_t))) == NULL ||
+            (lat != NULL &&
+             (tl = (double *)malloc(n * nrepeat * sizeof(double))) == NULL))
+        {
+            perror("malloc");
+            exit(1);
+        }
+        pthread_barrier_init(&go, NULL, n);
+        for (k = 0; k < n; k++) {
+            ss[k].a = &st[k];
+            ss[k].k = k;
+            ss[k].nrepeat = nrepeat;
+            ss[k].pin = pin;
+            ss[k].lat = tl != NULL ? tl + k * nrepeat : NULL;
+            ss[k].go = &go;
+            if (pthread_create(&th[k], NULL, IncastSend, &ss[k]) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+        for (k = 0; k < n; k++)
+            pthread_join(th[k], NULL);
+
+        /* A round lasts until its last sender is acknowledged */
+        for (j = 0; lat != NULL && j < nrepeat; j++)
+            for (k = 0, lat[j] = 0.0; k < n; k++)
+                lat[j] = MAX(lat[j], tl[k * nrepeat + j]);
+
+        pthread_barrier_destroy(&go);
+        free(tl);
+        free(ss);
+        free(th);
+
+    } else {
+        if ((epfd = epoll_create(n)) < 0) {
+            perror("epoll_create");
+            exit(1);
+        }
+        if ((evs = (struct epoll_event *)malloc(n * sizeof(*evs))) == NULL ||
+            (got = (int *)malloc(n * sizeof(int))) == NULL)
+        {
+            perror("malloc");
+            exit(1);
+        }
+        for (k = 0; k < n; k++) {
+            ev.events = EPOLLIN;
+            ev.data.u32 = k;
+            if (epoll_ctl(epfd, EPOLL_CTL_ADD, st[k].commfd, &ev) < 0) {
+                perror("epoll_ctl");
+                exit(1);
+            }
+            if (comp != NULL) comp[k] = 0.0;
+        }
+
+        for (j = 0; j < nrepeat; j++) {
+            memset(got, 0, n * sizeof(int));
+            for (left = n, t0 = 0.0; left > 0; ) {
+                if ((nev = epoll_wait(epfd, evs, n, -1)) < 0) {
+                    if (errno == EINTR) continue;
+                    perror("epoll_wait");
+                    exit(1);
+                }
+                if (t0 == 0.0) t0 = When();
+                for (e = 0; e < nev; e++) {
+                    k = evs[e].data.u32;
+                    r = read(st[k].commfd, st[k].r_ptr + got[k], bufflen - got[k]);
+                    if (r <= 0) {
+                        printf("NetPIPE: incast read failed on stream %d, errno=%d\n",
+                               k, errno);
+                        exit(401);
+                    }
+                    if ((got[k] += r) == bufflen) {
+                        t = When() - t0;
+                        if (comp != NULL) comp[k] += t / nrepeat;
+                        left--;
+                    }
+                }
+            }
+            busy += When() - t0;
+            for (k = 0; k < n; k++)
+                SendRepeat(&st[k], j);
+        }
+
+        close(epfd);
+        free(evs);
+        free(got);
+    }
+
+    for (k = 0; k < n; k++)
+        free(st[k].s_ptr);
+    return busy;
+}
+
+#endif
+
+#endif
+
+#if defined(RXPOLL)
+
+void PrintPolicy(FILE *out, int policy)
+{
+    if (RX_MODE(policy) == RX_BUSY)
+        fprintf(out, "busy polling %d usec", RX_USEC(policy));
+    else if (RX_MODE(policy) == RX_HYBRID)
+        fprintf(out, "spinning %d usec, then blocking", RX_USEC(policy));
+    else if (RX_MODE(policy) == RX_ADAPT)
+        fprintf(out, "spinning adaptively up to %d usec", RX_USEC(policy));
+    else
+        fprintf(out, RX_MODE(policy) == RX_SPIN ? "spinning" : "blocking");
+}
+
+/* Set the receive policy RecvData() waits for data with from now on.  A
+ * socket still set up for busy polling stops it, the next busy polling
+ * receive sets up whatever socket is then in use.
+ */
+void SetRecvPolicy(ArgStruct *p, int policy)
+{
+#if defined(BUSYPOLL)
+    int zero = 0;
+
+    if (p->rxfd >= 0 && p->rxfd == p->commfd)
+    {
+        setsockopt(p->commfd, SOL_SOCKET, SO_BUSY_POLL, &zero, sizeof(zero));
+#if defined(SO_PREFER_BUSY_POLL)
+        setsockopt(p->commfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &zero, sizeof(zero));
+#endif
+    }
+#endif
+    p->rxfd = -1;
+    p->rxpoll = RX_MODE(policy);
+    p->rxusec = RX_USEC(policy);
+    p->rxbudget = p->rxusec * 1000LL;   /* The adaptive one starts at its cap */
+    p->rxwait = p->rxbudget / 2;
+}
+
+/* Receive len bytes at buf for RecvData() of the socket modules under
+ * -J, spinning instead of sleeping until the data is there.  Each
+ * receive of a busy polling socket first polls the device queue for up
+ * to rxusec microseconds.  The hybrid and adaptive policies spin for
+ * their budget only, counted from the first receive that found nothing,
+ * then block.  The adaptive one keeps a moving average of how long it
+ * waited, and spins for twice that next time, or not at all once that
+ * is more than its cap, as blocking then costs less than the spinning
+ * saves.  Returns the bytes received, fewer at end of file, or -1 on
+ * an error.
+ */
+int RecvPolled(ArgStruct *p, char *buf, int len)
+{
+    int got = 0, n, flags = MSG_DONTWAIT;
+    unsigned long long t0 = 0, now;
+    long long budget = p->rxpoll == RX_ADAPT ? p->rxbudget : p->rxusec * 1000LL;
+    int limited = p->rxpoll == RX_HYBRID || p->rxpoll == RX_ADAPT;
+#if defined(BUSYPOLL)
+    int one = 1;
+
+    if (p->rxpoll == RX_BUSY && p->rxfd != p->commfd)
+    {
+        if (setsockopt(p->commfd, SOL_SOCKET, SO_BUSY_POLL, &p->rxusec,
+                       sizeof(p->rxusec)) < 0)
+        {
+            printf("setsockopt: SO_BUSY_POLL failed! errno=%d\n", errno);
+            exit(556);
+        }
+#if defined(SO_PREFER_BUSY_POLL)
+        /* Only a preference, which takes CAP_NET_ADMIN */
+        setsockopt(p->commfd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+#endif
+        p->rxfd = p->commfd;
+    }
+#endif
+
+    p->rxcalls++;
+    while (got < len)
+    {
+        if (p->syscalls >= 0) p->syscalls++;
+        n = recv(p->commfd, buf + got, len - got, flags);
+        if (n > 0)
+            got += n;
+        else if (n == 0)
+            break;
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return -1;
+        else if (limited && flags)
+        {
+            now = ReadClockNs();
+            if (t0 == 0)
+                t0 = now;
+            if (now - t0 >= (unsigned long long)budget)
+            {
+                flags = 0;      /* Out of budget, block from now on */
+                p->rxblocks++;
+            }
+        }
+    }
+
+    if (p->rxpoll == RX_ADAPT)
+    {
+        now = t0 ? ReadClockNs() : t0;
+        p->rxwait += ((long long)(now - t0) - p->rxwait) / 8;
+        p->rxbudget = 2 * p->rxwait <= p->rxusec * 1000LL ? 2 * p->rxwait : 0;
+    }
+    return got;
+}
+
+#endif
+
+void MetricsReset(Metrics *m)
+{
+    memset(m, 0, sizeof(Metrics));
+}
+
+void MetricSet(Metrics *m, int id, long long val)
+{
+    m->val[id]  = val;
+    m->have[id] = 1;
+}
+
+/* Send the metrics this side has, as described in netpipe.h */
+void SendMetrics(ArgStruct *p, Metrics *m)
+{
+    int i, count = 0;
+
+    for (i = 0; i < NMETRICS; i++)
+        count += m->have[i];
+
+    SendRepeat(p, RESULT_VERSION);
+    SendRepeat(p, count);
+    for (i = 0; i < NMETRICS; i++) {
+        if (!m->have[i]) continue;
+        SendRepeat(p, i);
+        SendRepeat(p, (int)((unsigned long long)m->val[i] >> 32));
+        SendRepeat(p, (int)(m->val[i] & 0xffffffffULL));
+    }
+}
+
+/* Receive the other side's metrics.  Single-process modules such as
+ * memcpy have no other side and leave the version at 0.
+ */
+void RecvMetrics(ArgStruct *p, Metrics *m)
+{
+    int version = 0, count = 0, i, id, hi, lo;
+
+    MetricsReset(m);
+
+    RecvRepeat(p, &version);
+    if (version < 1) return;
+
+    RecvRepeat(p, &count);
+    for (i = 0; i < count; i++) {
+        RecvRepeat(p, &id);
+        RecvRepeat(p, &hi);
+        RecvRepeat(p, &lo);
+        if (id >= 0 && id < NMETRICS)   /* Skip ids from newer versions */
+            MetricSet(m, id, (long long)(((unsigned long long)(unsigned int)hi << 32)
+                                         | (unsigned int)lo));
+    }
+}
+
+/* Send the test configuration to the receiver, as described in netpipe.h */
+void SendConfig(ArgStruct *p, RunInfo *ri)
+{
+    long long v[NCONFIG];
+    int i;
+
+    v[CFG_START]        = ri->start;
+    v[CFG_END]          = ri->end;
+    v[CFG_PERTURBATION] = ri->perturbation;
+    v[CFG_NREPEAT]      = ri->nrepeat;
+    v[CFG_STREAM]       = ri->stream;
+    v[CFG_INTEGRITY]    = ri->integrity;
+    v[CFG_TRIALS]       = ri->trials;
+    v[CFG_DISCARD]      = ri->discard;
+    v[CFG_WARMUP_N]     = ri->warmup_n;
+    v[CFG_HISTOGRAM]    = ri->histogram;
+    v[CFG_RUNTM]        = llround(ri->runtm * 1.0e9);
+    v[CFG_PRECISION]    = llround(ri->precision * 1.0e9);
+    v[CFG_BUDGET]       = llround(ri->budget * 1.0e9);
+    v[CFG_WARMUP_T]     = llround(ri->warmup_t * 1.0e9);
+    v[CFG_WARMUP_PCT]   = llround(ri->warmup_pct * 1.0e9);
+    v[CFG_CACHE]        = p->cache;
+    v[CFG_SOFFSET]      = p->soffset;
+    v[CFG_ROFFSET]      = p->roffset;
+    v[CFG_BIDIR]        = p->bidir;
+    v[CFG_PREBURST]     = p->preburst;
+    v[CFG_RESET_CONN]   = p->reset_conn;
+    v[CFG_LOOPS]        = ri->loops;
+    v[CFG_WINDOW]       = ri->winmax;
+    v[CFG_INFLIGHT]     = ri->inflight;
+    v[CFG_ORATE]        = llround(ri->orate * 1.0e9);
+    v[CFG_POISSON]      = ri->poisson;
+    v[CFG_RESPONSE]     = ri->response;
+    v[CFG_SERVICE]      = llround(ri->service * 1.0e9);
+    v[CFG_SERVICE_EXP]  = ri->service_exp;
+    v[CFG_TRACE]        = ri->trace;
+    v[CFG_DIST]         = ri->dist;
+    v[CFG_DIST_SEED]    = ri->dist_seed;
+    v[CFG_STREAMS]      = ri->streams;
+    v[CFG_PIN]          = ri->pin;
+    v[CFG_INCAST]       = ri->incast;
+    v[CFG_LOAD]         = ri->load;
+    v[CFG_ZEROCOPY]     = ri->zerocopy;
+    v[CFG_RXPOLL]       = ri->rxpoll;
+
+    SendRepeat(p, CONFIG_VERSION);
+    SendRepeat(p, NCONFIG);
+    for (i = 0; i < NCONFIG; i++) {
+        SendRepeat(p, i);
+        SendRepeat(p, (int)((unsigned long long)v[i] >> 32));
+        SendRepeat(p, (int)(v[i] & 0xffffffffULL));
+    }
+}
+
+/* Receive the transmitter's configuration into ri and the ArgStruct.
+ * Fields not sent keep the receiver's own values.  Returns the number of
+ * fields that differed from the receiver's command line, or -1 if the
+ * module has no other side to send one (memcpy).
+ */
+int RecvConfig(ArgStruct *p, RunInfo *ri)
+{
+    long long v;
+    int version = 0, count = 0, i, id, hi, lo, diff = 0;
+
+    RecvRepeat(p, &version);
+    if (version < 1) return -1;
+
+    RecvRepeat(p, &count);
+    for (i = 0; i < count; i++) {
+        RecvRepeat(p, &id);
+        RecvRepeat(p, &hi);
+        RecvRepeat(p, &lo);
+        v = (long long)(((unsigned long long)(unsigned int)hi << 32)
+                        | (unsigned int)lo);
+
+#define SETCFG(field, val) \
+        do { if ((field) != (val)) diff++; (field) = (val); } while (0)
+
+        switch (id) {
+        case CFG_START:        SETCFG(ri->start, v);             break;
+        case CFG_END:          SETCFG(ri->end, v);               break;
+        case CFG_PERTURBATION: SETCFG(ri->perturbation, v);      break;
+        case CFG_NREPEAT:      SETCFG(ri->nrepeat, v);           break;
+        case CFG_STREAM:       SETCFG(ri->stream, v);            break;
+        case CFG_INTEGRITY:    SETCFG(ri->integrity, v);         break;
+        case CFG_TRIALS:       SETCFG(ri->trials, v);            break;
+        case CFG_DISCARD:      SETCFG(ri->discard, v);           break;
+        case CFG_WARMUP_N:     SETCFG(ri->warmup_n, v);          break;
+        case CFG_HISTOGRAM:    SETCFG(ri->histogram, v);         break;
+        case CFG_RUNTM:        SETCFG(ri->runtm, v / 1.0e9);     break;
+        case CFG_PRECISION:    SETCFG(ri->precision, v / 1.0e9); break;
+        case CFG_BUDGET:       SETCFG(ri->budget, v / 1.0e9);    break;
+        case CFG_WARMUP_T:     SETCFG(ri->warmup_t, v / 1.0e9);  break;
+        case CFG_WARMUP_PCT:   SETCFG(ri->warmup_pct, v / 1.0e9);break;
+        case CFG_CACHE:        SETCFG(p->cache, v);              break;
+        case CFG_SOFFSET:      SETCFG(p->soffset, v);            break;
+        case CFG_ROFFSET:      SETCFG(p->roffset, v);            break;
+        case CFG_BIDIR:        SETCFG(p->bidir, v);              break;
+        case CFG_PREBURST:     SETCFG(p->preburst, v);           break;
+        case CFG_RESET_CONN:   SETCFG(p->reset_conn, v);         break;
+        case CFG_LOOPS:        SETCFG(ri->loops, v);             break;
+        case CFG_WINDOW:       SETCFG(ri->winmax, v);            break;
+        case CFG_INFLIGHT:     SETCFG(ri->inflight, v);          break;
+        case CFG_ORATE:        SETCFG(ri->orate, v / 1.0e9);     break;
+        case CFG_POISSON:      SETCFG(ri->poisson, v);           break;
+        case CFG_RESPONSE:     SETCFG(ri->response, v);          break;
+        case CFG_SERVICE:      SETCFG(ri->service, v / 1.0e9);   break;
+        case CFG_SERVICE_EXP:  SETCFG(ri->service_exp, v);       break;
+        case CFG_TRACE:        SETCFG(ri->trace, v);             break;
+        case CFG_DIST:         SETCFG(ri->dist, v);              break;
+        case CFG_DIST_SEED:    SETCFG(ri->dist_seed, v);         break;
+        case CFG_STREAMS:      SETCFG(ri->streams, v);           break;
+        case CFG_PIN:          SETCFG(ri->pin, v);               break;
+        case CFG_INCAST:       SETCFG(ri->incast, v);            break;
+        case CFG_LOAD:         SETCFG(ri->load, v);              break;
+        case CFG_ZEROCOPY:     SETCFG(ri->zerocopy, v);          break;
+        case CFG_RXPOLL:       SETCFG(ri->rxpoll, v);            break;
+        default:               break;  /* Field from a newer version */
+        }
+
+#undef SETCFG
+    }
+
+    return diff;
+}
+
+/* Fill in the host identification part of a RunInfo */
+void GetHostInfo(RunInfo *ri)
+{
+    struct utsname u;
+    FILE  *fd;
+    char   line[1024], path[256], *c;
+    int    i;
+
+    strcpy(ri->hostname, "unknown");
+    gethostname(ri->hostname, sizeof(ri->hostname) - 1);
+
+    strcpy(ri->kernel, "unknown");
+    if (uname(&u) == 0)
+        snprintf(ri->kernel, sizeof(ri->kernel), "%.*s %.*s %.*s %.*s",
+                 32, u.sysname, 64, u.release, 96, u.version, 32, u.machine);
+
+    strcpy(ri->cpu, "unknown");
+    ri->ncpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if ((fd = fopen("/proc/cpuinfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), fd) != NULL) {
+            if (!strncmp(line, "model name", 10) && (c = strchr(line, ':'))) {
+                for (c++; *c == ' ' || *c == '\t'; c++) ;
+                c[strcspn(c, "\n")] = '\0';
+                snprintf(ri->cpu, sizeof(ri->cpu), "%s", c);
+                break;
+            }
+        }
+        fclose(fd);
+    }
+
+    for (i = 0; i < NSYSCTL; i++) {
+        strcpy(ri->sysctl[i], "");
+        snprintf(path, sizeof(path), "/proc/sys/%s", sysctl_names[i]);
+        for (c = path + strlen("/proc/sys/"); *c; c++)
+            if (*c == '.') *c = '/';
+        if ((fd = fopen(path, "r")) != NULL) {
+            if (fgets(ri->sysctl[i], sizeof(ri->sysctl[i]), fd) != NULL)
+                ri->sysctl[i][strcspn(ri->sysctl[i], "\n")] = '\0';
+            fclose(fd);
+        }
+    }
+}
+
+/* Write a string as a quoted JSON or CSV field */
+static void WriteString(FILE *out, int format, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"')
+            fputs(format == OUT_JSON ? "\\\"" : "\"\"", out);
+        else if (format == OUT_JSON && *str == '\\')
+            fputs("\\\\", out);
+        else if (format == OUT_JSON && (unsigned char)*str < ' ')
+            fprintf(out, "\\u%04x", *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+/* Start a field; JSON fields are named, CSV fields follow the header */
+static void Field(FILE *out, int format, int *nfield, const char *name)
+{
+    if ((*nfield)++ > 0) fputc(',', out);
+    if (format == OUT_JSON) {
+        WriteString(out, format, name);
+        fputc(':', out);
+    }
+}
+
+/* Write a set of metrics as a JSON object named prefix, or as CSV
+ * columns prefix_<metric>.  Metrics the side did not measure are null
+ * or empty.
+ */
+static void WriteMetrics(FILE *out, int format, int *nf, char *prefix,
+                         Metrics *m)
+{
+    char name[64];
+    int  i, nm = 0;
+
+    if (format == OUT_JSON) {
+        Field(out, format, nf, prefix);
+        fputc('{', out);
+        for (i = 0; i < NMETRICS; i++) {
+            Field(out, format, &nm, metric_names[i]);
+            if (m->have[i]) fprintf(out, "%lld", m->val[i]);
+            else            fputs("null", out);
+        }
+        fputc('}', out);
+    } else {
+        for (i = 0; i < NMETRICS; i++) {
+            snprintf(name, sizeof(name), "%s_%s", prefix, metric_names[i]);
+            Field(out, format, nf, name);
+            if (m->have[i]) fprintf(out, "%lld", m->val[i]);
+        }
+    }
+}
+
+/* CSV needs a header line naming the columns written by WriteResult() */
+void WriteHeader(FILE *out, int format)
+{
+    int i;
+
+    if (format != OUT_CSV) return;
+
+    fprintf(out, "module,side,host,peer,kernel,cpu,ncpus,timer,"
+                 "start,end,perturbation,nrepeat_const,cache,soffset,roffset,"
+                 "stream,bidir,sockbuf,integrity,trials_max,discard,runtm,"
+                 "precision,budget,warmup_iters,warmup_secs,warmup_pct,loops,window_max,inflight,"
+                 "offered_start,poisson,response,service_ns,service_exp,trace,dist,dist_seed,"
+                 "streams,pin,incast,load,zerocopy,rxpoll");
+    for (i = 0; i < NSYSCTL; i++)
+        fprintf(out, ",%s", sysctl_names[i]);
+    fprintf(out, ",loop,window,bytes,repeat,mbps,time,elapsed,median,ci_lo,ci_hi,trials,"
+                 "trial_times,p50,p90,p99,p99.9,p99.99,max,variance,"
+                 "pkg0_joules,pkg1_joules,energy_window,offered_rate,msg_rate,cpu_ns_per_msg,"
+                 "peer_cpu_ns_per_msg,nstreams,jain,stream_mbps,stream_completion,"
+                 "targets,target_p50,target_p99,target_max,"
+                 "load_sockbuf,bulk_mbps,inflation,p99_inflation,"
+                 "zc_modes,zc_speedup,zc_cpu_ratio,zc_copied,zc_mapped,zc_cpu_saved_per_byte,"
+                 "rx_mode,rx_usec,rx_latency_gain_ns,rx_extra_cpu_ns,rx_budget_ns,rx_blocked,"
+                 "rx_joules_per_msg,"
+                 "syscalls_per_msg,peer_syscalls_per_msg");
+    for (i = 0; i < NMETRICS; i++)
+        fprintf(out, ",local_%s", metric_names[i]);
+    for (i = 0; i < NMETRICS; i++)
+        fprintf(out, ",peer_%s", metric_names[i]);
+    fprintf(out, "\n");
+    fflush(out);
+}
+
+/* Write one data point as a JSON line or a CSV row.  trial_t holds the
+ * kept trial times (NULL on the receiver) and h the latency histogram
+ * (NULL if not recorded).  local and remote are the metrics of this side
+ * and of the other side, joined into the same record.
+ */
+void WriteResult(FILE *out, int format, RunInfo *ri, ArgStruct *p,
+                 Data *d, double *trial_t, Hist *h,
+                 Metrics *local, Metrics *remote)
 {
-    struct timeval tp;
-    gettimeofday(&tp, NULL);
-    return ((double) tp.tv_sec + (double) tp.tv_usec * 1e-6);
+    int nf = 0, i, j, sockbuf = 0;
+    static double pcts[5] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+    static char  *pnames[5] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+
+#if defined(TCP) || defined(URING) || defined(TCP6) || defined(SCTP) || defined(SCTP6) || defined(IPX)
+    sockbuf = p->prot.sndbufsz;
+#endif
+
+    if (format == OUT_JSON) fputc('{', out);
+
+    Field(out, format, &nf, "module");  WriteString(out, format, NPMODULE);
+    Field(out, format, &nf, "side");
+    WriteString(out, format, p->tr ? "transmitter" : "receiver");
+    Field(out, format, &nf, "host");    WriteString(out, format, ri->hostname);
+    Field(out, format, &nf, "peer");
+    WriteString(out, format, p->host ? p->host : "");
+    Field(out, format, &nf, "kernel");  WriteString(out, format, ri->kernel);
+    Field(out, format, &nf, "cpu");     WriteString(out, format, ri->cpu);
+    Field(out, format, &nf, "ncpus");   fprintf(out, "%d", ri->ncpus);
+    Field(out, format, &nf, "timer");
+    WriteString(out, format, ri->timer == TIMER_TSC ? "tsc" : "mono");
+
+    if (format == OUT_JSON) { Field(out, format, &nf, "config"); fputc('{', out); nf = 0; }
+    Field(out, format, &nf, "start");         fprintf(out, "%d", ri->start);
+    Field(out, format, &nf, "end");           fprintf(out, "%d", ri->end);
+    Field(out, format, &nf, "perturbation");  fprintf(out, "%d", ri->perturbation);
+    Field(out, format, &nf, "nrepeat_const"); fprintf(out, "%d", ri->nrepeat);
+    Field(out, format, &nf, "cache");         fprintf(out, "%d", p->cache);
+    Field(out, format, &nf, "soffset");       fprintf(out, "%d", p->soffset);
+    Field(out, format, &nf, "roffset");       fprintf(out, "%d", p->roffset);
+    Field(out, format, &nf, "stream");        fprintf(out, "%d", ri->stream);
+    Field(out, format, &nf, "bidir");         fprintf(out, "%d", p->bidir);
+    Field(out, format, &nf, "sockbuf");       fprintf(out, "%d", sockbuf);
+    Field(out, format, &nf, "integrity");     fprintf(out, "%d", ri->integrity);
+    Field(out, format, &nf, "trials_max");    fprintf(out, "%d", ri->trials);
+    Field(out, format, &nf, "discard");       fprintf(out, "%d", ri->discard);
+    Field(out, format, &nf, "runtm");         fprintf(out, "%g", ri->runtm);
+    Field(out, format, &nf, "precision");     fprintf(out, "%g", ri->precision);
+    Field(out, format, &nf, "budget");        fprintf(out, "%g", ri->budget);
+    Field(out, format, &nf, "warmup_iters");  fprintf(out, "%d", ri->warmup_n);
+    Field(out, format, &nf, "warmup_secs");   fprintf(out, "%g", ri->warmup_t);
+    Field(out, format, &nf, "warmup_pct");    fprintf(out, "%g", ri->warmup_pct);
+    Field(out, format, &nf, "loops");         fprintf(out, "%d", ri->loops);
+    Field(out, format, &nf, "window_max");    fprintf(out, "%d", ri->winmax);
+    Field(out, format, &nf, "inflight");      fprintf(out, "%d", ri->inflight);
+    Field(out, format, &nf, "offered_start"); fprintf(out, "%g", ri->orate);
+    Field(out, format, &nf, "poisson");       fprintf(out, "%d", ri->poisson);
+    Field(out, format, &nf, "response");      fprintf(out, "%d", ri->response);
+    Field(out, format, &nf, "service_ns");    fprintf(out, "%g", ri->service * 1.0e9);
+    Field(out, format, &nf, "service_exp");   fprintf(out, "%d", ri->service_exp);
+    Field(out, format, &nf, "trace");         fprintf(out, "%d", ri->trace);
+    Field(out, format, &nf, "dist");          fprintf(out, "%d", ri->dist);
+    Field(out, format, &nf, "dist_seed");     fprintf(out, "%d", ri->dist_seed);
+    Field(out, format, &nf, "streams");       fprintf(out, "%d", ri->streams);
+    Field(out, format, &nf, "pin");           fprintf(out, "%d", ri->pin);
+    Field(out, format, &nf, "incast");        fprintf(out, "%d", ri->incast);
+    Field(out, format, &nf, "load");          fprintf(out, "%d", ri->load);
+    Field(out, format, &nf, "zerocopy");      fprintf(out, "%d", ri->zerocopy);
+    Field(out, format, &nf, "rxpoll");        fprintf(out, "%d", ri->rxpoll);
+    if (format == OUT_JSON) { fputc('}', out); }
+
+    if (format == OUT_JSON) { Field(out, format, &nf, "sysctl"); fputc('{', out); nf = 0; }
+    for (i = 0; i < NSYSCTL; i++) {
+        Field(out, format, &nf, sysctl_names[i]);
+        WriteString(out, format, ri->sysctl[i]);
+    }
+    if (format == OUT_JSON) { fputc('}', out); }
+
+    Field(out, format, &nf, "loop");    fprintf(out, "%d", ri->loop);
+    Field(out, format, &nf, "window");  fprintf(out, "%d", ri->window);
+    Field(out, format, &nf, "bytes");   fprintf(out, "%d", d->bits / 8);
+    Field(out, format, &nf, "repeat");  fprintf(out, "%d", d->repeat);
+    Field(out, format, &nf, "mbps");    fprintf(out, "%.6f", d->bps);
+    Field(out, format, &nf, "time");    fprintf(out, "%.9e", d->t);
+    Field(out, format, &nf, "elapsed"); fprintf(out, "%.6f", d->elapsed);
+    Field(out, format, &nf, "median");  fprintf(out, "%.9e", d->tmed);
+    Field(out, format, &nf, "ci_lo");   fprintf(out, "%.9e", d->tlo);
+    Field(out, format, &nf, "ci_hi");   fprintf(out, "%.9e", d->thi);
+    Field(out, format, &nf, "trials");  fprintf(out, "%d", d->trials);
+
+    Field(out, format, &nf, "trial_times");
+    fputs(format == OUT_JSON ? "[" : "\"", out);
+    for (i = 0; trial_t != NULL && i < d->trials; i++)
+        fprintf(out, "%s%.9e", i ? (format == OUT_JSON ? "," : ";") : "",
+                trial_t[i]);
+    fputs(format == OUT_JSON ? "]" : "\"", out);
+
+    if (format == OUT_JSON) {
+        Field(out, format, &nf, "latency");
+        if (h == NULL) {
+            fputs("null", out);
+        } else {
+            fputc('{', out);
+            for (i = 0; i < 5; i++)
+                fprintf(out, "%s\"%s\":%.9e", i ? "," : "", pnames[i],
+                        HistPercentile(h, pcts[i]));
+            fprintf(out, ",\"max\":%.9e,\"mean\":%.9e,\"variance\":%.9e,"
+                    "\"samples\":%lld}", h->max, HistMean(h), d->variance,
+                    h->total);
+        }
+    } else {
+        for (i = 0; i < 5; i++) {
+            Field(out, format, &nf, pnames[i]);
+            if (h) fprintf(out, "%.9e", HistPercentile(h, pcts[i]));
+        }
+        Field(out, format, &nf, "max");
+        if (h) fprintf(out, "%.9e", h->max);
+        Field(out, format, &nf, "variance");
+        if (h) fprintf(out, "%.9e", d->variance);
+    }
+
+    /* Only the receiver samples RAPL, and negative joules mean the
+     * counters could not be read.
+     */
+    if (format == OUT_JSON) {
+        Field(out, format, &nf, "energy");
+        if (d->work > 0.0) {
+            if (d->joules0 >= 0.0)
+                fprintf(out, "{\"pkg0_joules\":%.6f,\"pkg1_joules\":%.6f,",
+                        d->joules0, d->joules1);
+            else
+                fputs("{\"pkg0_joules\":null,\"pkg1_joules\":null,", out);
+            fprintf(out, "\"window\":%.9f}", d->work);
+        } else {
+            fputs("null", out);
+        }
+    } else {
+        Field(out, format, &nf, "pkg0_joules");
+        if (d->joules0 >= 0.0 && d->work > 0.0) fprintf(out, "%.6f", d->joules0);
+        Field(out, format, &nf, "pkg1_joules");
+        if (d->joules1 >= 0.0 && d->work > 0.0) fprintf(out, "%.6f", d->joules1);
+        Field(out, format, &nf, "energy_window");
+        if (d->work > 0.0) fprintf(out, "%.9f", d->work);
+    }
+
+    Field(out, format, &nf, "offered_rate"); fprintf(out, "%.1f", d->offered);
+    Field(out, format, &nf, "msg_rate");  fprintf(out, "%.1f", d->msgrate);
+    Field(out, format, &nf, "cpu_ns_per_msg");
+    if (d->cpu_msg >= 0.0)           fprintf(out, "%.1f", d->cpu_msg);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "peer_cpu_ns_per_msg");
+    if (d->peer_cpu_msg >= 0.0)      fprintf(out, "%.1f", d->peer_cpu_msg);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "nstreams");  fprintf(out, "%d", d->streams);
+    Field(out, format, &nf, "jain");
+    if (d->stream_bps != NULL)       fprintf(out, "%.6f", d->jain);
+    else if (format == OUT_JSON)     fputs("null", out);
+
+    Field(out, format, &nf, "stream_mbps");
+    fputs(format == OUT_JSON ? "[" : "\"", out);
+    for (i = 0; d->stream_bps != NULL && i < d->streams; i++)
+        fprintf(out, "%s%.6f", i ? (format == OUT_JSON ? "," : ";") : "",
+                d->stream_bps[i]);
+    fputs(format == OUT_JSON ? "]" : "\"", out);
+
+    Field(out, format, &nf, "stream_completion");
+    fputs(format == OUT_JSON ? "[" : "\"", out);
+    for (i = 0; d->stream_comp != NULL && i < d->streams; i++)
+        fprintf(out, "%s%.9e", i ? (format == OUT_JSON ? "," : ";") : "",
+                d->stream_comp[i]);
+    fputs(format == OUT_JSON ? "]" : "\"", out);
+
+    /* Fanning out, the 50th and 99th percentile and maximum reply latency
+     * of each receiver, the first one first.
+     */
+    Field(out, format, &nf, "targets");  fprintf(out, "%d", d->targets);
+    for (j = 0; j < 3; j++) {
+        Field(out, format, &nf, j == 0 ? "target_p50" :
+                                j == 1 ? "target_p99" : "target_max");
+        fputs(format == OUT_JSON ? "[" : "\"", out);
+        for (i = 0; i < d->targets; i++)
+            fprintf(out, "%s%.9e", i ? (format == OUT_JSON ? "," : ";") : "",
+                    j == 2 ? d->target_hist[i].max :
+                    HistPercentile(&d->target_hist[i], j ? 99.0 : 50.0));
+        fputs(format == OUT_JSON ? "]" : "\"", out);
+    }
+
+    /* Under bulk load (-U), the bulk connection's socket buffer size, -1
+     * on the idle curve, and the growth of the latency over that curve's.
+     */
+    Field(out, format, &nf, "load_sockbuf");
+    if (ri->load)                    fprintf(out, "%d", d->load_buf);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "bulk_mbps");
+    if (ri->load)                    fprintf(out, "%.6f", d->bulk_bps);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "inflation");
+    if (ri->load && p->tr)           fprintf(out, "%.4f", d->inflation);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "p99_inflation");
+    if (ri->load && p->tr)           fprintf(out, "%.4f", d->p99_inflation);
+    else if (format == OUT_JSON)     fputs("null", out);
+
+    /* With -Z, the zero-copy modes of the point, and how it compares with
+     * the same point copying.
+     */
+    Field(out, format, &nf, "zc_modes");
+    if (ri->zerocopy)                fprintf(out, "%d", d->zerocopy);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "zc_speedup");
+    if (ri->zerocopy && p->tr)       fprintf(out, "%.4f", d->zc_speedup);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "zc_cpu_ratio");
+    if (ri->zerocopy && p->tr)       fprintf(out, "%.4f", d->zc_cpu);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "zc_copied");
+    if (ri->zerocopy)                fprintf(out, "%.4f", d->zc_copied);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "zc_mapped");
+    if (ri->zerocopy)                fprintf(out, "%.4f", d->zc_mapped);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "zc_cpu_saved_per_byte");
+    if (ri->zerocopy && p->tr)       fprintf(out, "%.4f", d->zc_saved);
+    else if (format == OUT_JSON)     fputs("null", out);
+    /* With -J, how the point's receives waited for data, what that
+     * gained over blocking in read() and cost in CPU time, the spin
+     * budget and how often it ran out, and the receiver's energy.
+     */
+    Field(out, format, &nf, "rx_mode");
+    if (ri->rxpoll)                  WriteString(out, format, rx_names[d->rx_mode]);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_usec");
+    if (ri->rxpoll)                  fprintf(out, "%d", d->rx_usec);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_latency_gain_ns");
+    if (ri->rxpoll && p->tr)         fprintf(out, "%.1f", d->rx_gain);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_extra_cpu_ns");
+    if (ri->rxpoll && p->tr)         fprintf(out, "%.1f", d->rx_cpu);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_budget_ns");
+    if (ri->rxpoll)                  fprintf(out, "%.0f", d->rx_budget);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_blocked");
+    if (ri->rxpoll)                  fprintf(out, "%.4f", d->rx_blocked);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "rx_joules_per_msg");
+    if (ri->rxpoll && d->rx_joules >= 0.0) fprintf(out, "%.9f", d->rx_joules);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "syscalls_per_msg");
+    if (d->sys_msg >= 0.0)           fprintf(out, "%.4f", d->sys_msg);
+    else if (format == OUT_JSON)     fputs("null", out);
+    Field(out, format, &nf, "peer_syscalls_per_msg");
+    if (d->peer_sys_msg >= 0.0)      fprintf(out, "%.4f", d->peer_sys_msg);
+    else if (format == OUT_JSON)     fputs("null", out);
+
+    WriteMetrics(out, format, &nf, "local", local);
+    WriteMetrics(out, format, &nf, "peer", remote);
+
+    if (format == OUT_JSON) fputc('}', out);
+    fputc('\n', out);
+    fflush(out);
 }
 
 /* 
@@ -881,7 +4725,7 @@ void PrintUsage()
     printf("a: asynchronous receive (a.k.a. preposted receive)\n");
 #endif
     printf("B: burst all preposts before measuring performance\n");
-#if (defined(TCP) || defined(TCP6)) && ! defined(INFINIBAND)
+#if (defined(TCP) || defined(URING) || defined(TCP6)) && ! defined(INFINIBAND)
     printf("b: specify TCP send/receive socket buffer sizes\n");
 #endif
 
@@ -897,30 +4741,110 @@ void PrintUsage()
     printf("   all MPI-2 implementations\n");
 #endif
 
-#if defined(TCP) || defined(TCP6) || defined(SCTP) || defined(SCTP6) || defined(INFINIBAND) || defined(OPENIB)
+#if defined(TCP) || defined(URING) || defined(TCP6) || defined(SCTP) || defined(SCTP6) || defined(INFINIBAND) || defined(OPENIB)
     printf("h: specify hostname of the receiver <-h host>\n");
 #endif
+#if defined(FANOUT)
+    printf("   given more than once <-h host[:port]>, fan each request out to\n"
+           "   all receivers and report each one's reply latencies\n");
+#endif
 
+    printf("C: select the timer <-C mono|tsc>\n"
+           "   mono: clock_gettime(CLOCK_MONOTONIC_RAW) (default)\n"
+           "   tsc:  invariant cycle counter (x86 TSC, ARM cntvct)\n");
+    printf("e: add trials until the 95%% CI of the median is within <-e pct>\n");
+    printf("E: time budget in seconds for each data point <-E 10>\n");
+    printf("F: output file format <-F plain|json|csv>; json and csv records\n"
+           "   include the configuration and host, the receiver writes its\n"
+           "   own records (with energy) to stdout\n");
+    printf("H: Record per-iteration latency histograms and report the\n"
+           "   50/90/99/99.9/99.99th percentiles and maximum of each point\n");
     printf("I: Invalidate cache (measure performance without cache effects).\n"
            "   This simulates data coming from main memory instead of cache.\n");
     printf("i: Do an integrity check instead of measuring performance\n");
+    printf("k: discard the first trials of each point as warmup <-k 1>\n");
     printf("l: lower bound start value e.g. <-l 1>\n");
+    printf("L: measure the whole curve this many times and summarize <-L 100>\n");
 
 #if defined(INFINIBAND) || defined(OPENIB)
     printf("m: set MTU for Infiniband adapter <-m mtu_size>\n");
     printf("   valid sizes: 256, 512, 1024, 2048, 4096 (default 1024)\n");
 #endif
 
+#if defined(OPENLOOP)
+    printf("Q: open-loop load from <-Q rate[,p]> requests/s, doubled each\n"
+           "   point until saturation; p for Poisson arrivals.  Latency\n"
+           "   is taken from each request's intended send time\n");
+#endif
+    printf("j: replay a trace of \"size gap_usec >|<\" lines or a pcap file\n"
+           "   of a TCP flow <-j file>; per-record latencies go to\n"
+           "   <output file>.records\n");
+    printf("G: draw message sizes from <-G uniform:min,max|bimodal:a,b,p|\n"
+           "   lognormal:median,sigma|cdf:file[@seed]>; per size bucket\n"
+           "   latencies go to <output file>.sizes\n");
+    printf("y: response size in bytes <-y 65536>; requests keep the swept size\n");
+    printf("x: receiver service time per request <-x ns[,e]>, e for an\n"
+           "   exponential distribution with that mean\n");
+    printf("M: message rate mode, keeping up to <-M 16> messages in flight;\n"
+           "   reports messages/s and CPU ns per message on both sides\n");
     printf("n: Set a constant value for number of repeats <-n 50>\n");
+    printf("N: number of trials per point, or the maximum with -e <-N 7>\n");
     printf("o: specify output filename <-o filename>\n");
     printf("O: specify transmit and optionally receive buffer offsets <-O 1,3>\n");
     printf("p: set the perturbation number <-p 1>\n"
            "   (default = 3 Bytes, set to 0 for no perturbations)\n");
 
-#if (defined(TCP) || defined(TCP6) || defined(SCTP) || defined(SCTP6)) && ! defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING) || defined(TCP6) || defined(SCTP) || defined(SCTP6)) && ! defined(INFINIBAND) && !defined(OPENIB)
     printf("r: reset sockets for every trial\n");
 #endif
+#if (defined(TCP) || defined(URING)) && ! defined(INFINIBAND) && !defined(OPENIB)
+    printf("K: receiver only, keep running and serve one transmitter\n"
+           "   after another, each with its own test configuration\n");
+#endif
 
+#if defined(MULTISTREAM)
+    printf("T: run each trial on <-T 4[,c]> concurrent connections, on ports\n"
+           "   after -P, c to pin stream k to core k; adds the Jain fairness\n"
+           "   index and each stream's rate\n");
+#endif
+#if defined(INCAST)
+    printf("V: incast from 1, 2, 4 ... up to <-V 16[,c]> senders at once, each\n"
+           "   on its own connection, to a receiver using epoll; adds each\n"
+           "   sender's rate and completion time\n");
+#endif
+#if defined(BULKLOAD)
+    printf("U: measure the curve idle, then while bulk data streams on a\n"
+           "   second connection with each of <-U 0,65536,4194304> byte socket\n"
+           "   buffers, 0 for the system's; adds the bulk rate and the growth\n"
+           "   of the time and 99th percentile over the idle curve\n");
+#endif
+#if defined(ZEROCOPY)
+    printf("Z: measure the curve copying, then with <-Z s> zero-copy sends\n"
+           "   (MSG_ZEROCOPY), <-Z r> receives into mapped pages\n"
+           "   (TCP_ZEROCOPY_RECEIVE) or <-Z sr> both; adds the speedup and\n"
+           "   CPU saving over copying, the share of sends the kernel copied\n"
+           "   anyway and of bytes received mapped\n");
+#endif
+#if defined(RXPOLL)
+    printf("J: measure the curve blocking in read(), then with each of a\n"
+           "   comma separated list of receive policies: <-J s> spins on\n"
+           "   recv(MSG_DONTWAIT)"
+#if defined(BUSYPOLL)
+           ", <-J b[usec]> busy polls the socket for usec\n"
+           "   (50) microseconds on each of those receives"
+#endif
+           ", <-J usec> spins\n"
+           "   that long, then blocks, <-J a[usec]> spins twice the mean wait\n"
+           "   up to usec (100), then blocks; adds the latency gained, CPU\n"
+           "   time spent over blocking and energy per message, and prints\n"
+           "   p50/p99 latency against energy per message of each policy;\n"
+           "   list the spin budgets to sweep, as in <-J 5,10,20,50>\n");
+#endif
+#if defined(URING)
+    printf("q: have a kernel thread poll the io_uring for submissions and\n"
+           "   poll it for completions, instead of a system call to each\n");
+#endif
+    printf("R: target run time of each trial in seconds <-R 0.25>\n");
     printf("s: stream data in one direction only.\n");
 #if defined(MPI)
     printf("S: Use synchronous sends.\n");
@@ -950,12 +4874,17 @@ void PrintUsage()
     printf("z: receive messages using the MPI_ANY_SOURCE flag\n");
 #endif
 
+    printf("W: sweep windows of 1, 2, 4 ... up to <-W 64> messages sent\n"
+           "   back-to-back, each window acknowledged by the receiver\n");
+    printf("w: untimed warmup before each point <-w iterations[,pct]>\n"
+           "   or <-w seconds's'[,pct]>; with pct, continue until the\n"
+           "   latency of successive warmup blocks agrees within pct %%\n");
     printf("2: Send data in both directions at the same time.\n");
     printf("P: Set the port number to one other than the default.\n");
 #if defined(MPI)
     printf("   May need to use -a to choose asynchronous communications for MPI/n");
 #endif
-#if (defined(TCP) || defined(TCP6) || defined(SCTP) || defined (SCTP6)) && !defined(INFINIBAND) && !defined(OPENIB)
+#if (defined(TCP) || defined(URING) || defined(TCP6) || defined(SCTP) || defined (SCTP6)) && !defined(INFINIBAND) && !defined(OPENIB)
     printf("   The maximum test size is limited by the TCP buffer size\n");
 #endif
 #if defined(TCP)
@@ -1033,7 +4962,7 @@ void InitBufferData(ArgStruct *p, int nbytes, int soffset, int roffset)
 
     memset(p->s_buff, 'b', nbytes+soffset);
 }
-#if !defined(OPENIB) && !defined(INFINIBAND) && !defined(ARMCI) && !defined(LAPI) && !defined(GPSHMEM) && !defined(SHMEM) && !defined(GM) 
+#if !defined(OPENIB) && !defined(INFINIBAND) && !defined(ARMCI) && !defined(LAPI) && !defined(GPSHMEM) && !defined(SHMEM) && !defined(GM) && !defined(URING) 
 
 void MyMalloc(ArgStruct *p, int bufflen, int soffset, int roffset)
 {
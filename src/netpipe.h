@@ -12,13 +12,18 @@
 /*                                                                           */
 /*     * netpipe.h          ---- General include file                        */
 /*****************************************************************************/
+#if defined(TCP) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE         /* pthread_setaffinity_np() for -T */
+#endif
 #include <ctype.h>
 #include <errno.h>
+#include <math.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/time.h>       /* struct timeval */
+#include <time.h>           /* clock_gettime() */
 #include <sys/resource.h>   /* getrusage() */
 #include <stdlib.h>         /* malloc(3) */
 #include <unistd.h>         /* getopt, read, write, ... */
@@ -44,6 +49,7 @@
   #define  RUNTM              0.10
 #endif
 
+#define  MAXTRIALS          1000
 #define  MEMSIZE            10000000 
 #define  DEFPORT            5002
 #define  NSAMP              8000
@@ -52,12 +58,45 @@
 #define  CHARSIZE           8
 #define  STOPTM             1.0
 #define  MAXINT             10000000
+#define  TIMER_MONO         0      /* clock_gettime(CLOCK_MONOTONIC_RAW)   */
+#define  TIMER_TSC          1      /* Invariant TSC / ARM virtual counter  */
+#define  OUT_PLAIN          0      /* Columns for gnuplot (default)        */
+#define  OUT_JSON           1      /* One JSON object per line             */
+#define  OUT_CSV            2      /* Comma-separated with a header line   */
+#define  NSYSCTL            10     /* Sysctls recorded with the results    */
+#define  HIST_SUBBITS       6      /* log2 of linear sub-buckets per octave */
+#define  HIST_SUB           (1 << HIST_SUBBITS)
+#define  HIST_NBINS         (HIST_SUB * 60) /* covers any 64-bit ns value */
 /*#define  MAXINT             1048576*/
 
 #define     ABS(x)     (((x) < 0)?(-(x)):(x))
 #define     MIN(x,y)   (((x) < (y))?(x):(y))
 #define     MAX(x,y)   (((x) > (y))?(x):(y))
 
+/* The open-loop load generator (-Q) sends and receives on the same socket
+ * from two threads, which only the TCP module is known to allow.  The
+ * concurrent streams of -T each run in a thread on their own connection,
+ * which only the TCP module can open next to the first one, and only it
+ * can fan out to several receivers (-h given more than once) or stream
+ * bulk data on a second connection during the ping-pong (-U).
+ */
+#if defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)
+  #define OPENLOOP
+  #define MULTISTREAM
+  #define FANOUT
+  #define MAXFAN           64     /* Most receivers to fan out to         */
+  #define BULKLOAD
+  #define MAXLOAD          16     /* Most bulk socket buffer sizes        */
+  #define BULKCHUNK        131072 /* Bytes per bulk write or read         */
+  #include <pthread.h>
+  #include <sched.h>
+  #include <poll.h>
+  #if defined(__linux__)      /* The incast receiver (-V) uses epoll */
+    #define INCAST
+    #include <sys/epoll.h>
+  #endif
+#endif
+
 /* Need to include the protocol structure header file.                       */
 /* Change this to reflect the protocol                                       */
 
@@ -67,6 +106,19 @@
   #include <netinet/in.h>
   #include <netinet/tcp.h>
   #include <arpa/inet.h>
+
+  /* Zero-copy sends (-Z) are released through the socket error queue,
+   * zero-copy receives map pages into an mmap() of the socket.
+   */
+  #if defined(__linux__) && defined(MSG_ZEROCOPY) && ! defined(INFINIBAND) && !defined(OPENIB)
+    #define ZEROCOPY
+    #define ZC_SEND          1      /* -Z s: send with MSG_ZEROCOPY         */
+    #include <linux/errqueue.h>
+    #if defined(TCP_ZEROCOPY_RECEIVE)
+      #define ZC_RECV        2      /* -Z r: map received pages             */
+      #include <sys/mman.h>
+    #endif
+  #endif
   
   typedef struct protocolstruct ProtocolStruct;
   struct protocolstruct
@@ -87,6 +139,19 @@
       int                     commtype; /* Communications type            */
       int                     comptype; /* Completion type                */
       char                    *device_and_port; /* Local port specification */
+#endif
+#if defined(ZEROCOPY)
+      int                     zerocopy; /* ZC_ modes in use               */
+      int                     zc_on;    /* SO_ZEROCOPY set on the socket  */
+      unsigned int            zc_sent,  /* Zero-copy sends so far, those  */
+                              zc_done,  /*   the kernel released, and of  */
+                              zc_copied;/*   them those it copied anyway  */
+#endif
+#if defined(ZC_RECV)
+      char                    *zc_map;  /* Mapping of the socket that     */
+      size_t                  zc_maplen;/*   received pages go to         */
+      unsigned long long      zc_rbytes,/* Bytes received by -Z r, and    */
+                              zc_mapped;/*   those mapped, not copied     */
 #endif
   };
 
@@ -104,6 +169,60 @@ enum communication_types {
 };
 #endif
 
+#elif defined(URING)
+  #include <netdb.h>
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <netinet/tcp.h>
+  #include <arpa/inet.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <sys/uio.h>
+  #include <linux/io_uring.h>
+
+  #define URING_ENTRIES    64       /* Submission queue entries            */
+  #define URING_NBUF       64       /* Provided receive buffers, and their */
+  #define URING_BUFSZ      65536    /*   size                              */
+
+  typedef struct protocolstruct ProtocolStruct;
+  struct protocolstruct
+  {
+      struct sockaddr_in      sin1,   /* socket structure #1              */
+                              sin2;   /* socket structure #2              */
+      int                     nodelay;  /* Flag for TCP nodelay           */
+      struct hostent          *addr;    /* Address of host                */
+      int                     sndbufsz, /* Size of TCP send buffer        */
+                              rcvbufsz; /* Size of TCP receive buffer     */
+      int                     sqpoll;   /* Kernel thread polls the SQ (-q)*/
+      int                     ring_fd;  /* The ring, -1 if there is none  */
+      void                    *sq_ring, /* Mappings of the submission and */
+                              *cq_ring; /*   completion queues            */
+      size_t                  sq_ringsz, cq_ringsz, sqes_sz;
+      unsigned                *sq_head, *sq_tail, *sq_mask, *sq_entries,
+                              *sq_flags, *sq_array;
+      unsigned                sq_local, /* Our submission queue tail, and */
+                              to_submit;/*   entries not yet submitted    */
+      struct io_uring_sqe     *sqes;
+      unsigned                *cq_head, *cq_tail, *cq_mask;
+      struct io_uring_cqe     *cqes;
+      struct io_uring_buf_ring *br;     /* Provided buffer ring, its tail */
+      unsigned short          br_tail;  /*   and the buffers it hands out */
+      char                    *bufs;
+      int                     rq_bid[URING_NBUF], /* Filled buffers not   */
+                              rq_len[URING_NBUF]; /*   yet copied out     */
+      unsigned                rq_head, rq_tail;
+      int                     rq_off;   /* Bytes copied from the first    */
+      int                     armed,    /* Multishot receive posted       */
+                              eof;      /* Peer closed the connection     */
+      char                    *s_next;  /* Rest of the message in flight  */
+      int                     s_left,
+                              sending,  /* ... unless the send is done    */
+                              s_fixed,  /* ... written from a registered  */
+                                        /*   buffer, and may be short     */
+                              fixed;    /* Buffers registered with ring   */
+      char                    ctl[16];  /* Control message in flight      */
+  };
+
 #elif defined(SCTP6)
   #include <netdb.h>
   #include <sys/socket.h>
@@ -280,8 +399,32 @@ enum communication_types {
   };
 
 #else
-  #error "One of TCP, TCP6, SCTP, SCTP6, IPX, MPI, PVM, TCGMSG, LAPI, SHMEM, ATOLL, MEMCPY, DISK must be defined during compilation"
+  #error "One of TCP, URING, TCP6, SCTP, SCTP6, IPX, MPI, PVM, TCGMSG, LAPI, SHMEM, ATOLL, MEMCPY, DISK must be defined during compilation"
+
+#endif
 
+/* The socket modules can poll for received data instead of sleeping in
+ * read() (-J), spinning on recv(MSG_DONTWAIT), on Linux also with the
+ * socket set to busy poll the device queue on each of those receives,
+ * or spin for a budget and then block, a fixed one or one that follows
+ * the waits seen.  A policy is a mode and its microseconds in one int,
+ * as it is sent.
+ */
+#if (defined(TCP) && ! defined(INFINIBAND) && !defined(OPENIB)) || defined(TCP6) || defined(SCTP)
+  #define RXPOLL
+  #define MAXPOLL          16     /* Most receive policies compared       */
+  #define RX_BLOCK         0      /* Block in read() as usual             */
+  #define RX_SPIN          1      /* -J s: spin on recv(MSG_DONTWAIT)     */
+  #define RX_BUSY          2      /* -J b: ... with SO_BUSY_POLL set      */
+  #define RX_HYBRID        3      /* -J usec: spin that long, then block  */
+  #define RX_ADAPT         4      /* -J a: spin twice the mean wait, up   */
+                                  /*   to a cap, or block if it is over   */
+  #define RX_POLICY(m,u)   ((m) | (u) << 4)
+  #define RX_MODE(x)       ((x) & 15)
+  #define RX_USEC(x)       ((x) >> 4)
+  #if defined(__linux__) && defined(SO_BUSY_POLL)
+    #define BUSYPOLL
+  #endif
 #endif
 
 
@@ -318,6 +461,21 @@ struct argstruct
     int      soffset,roffset;
     int      syncflag; /* flag for using sync sends vs. normal sends in MPI mod*/
     int	     use_sdp;       /* Use AF_INET_SDP instead of AF_INET */
+    int      connect_retry; /* Retry refused connects, the peer is not yet  */
+                            /* listening (extra streams of -T)               */
+    int      nfan;          /* Extra receivers the transmitter fans out to   */
+    struct argstruct *fan;  /* ... and their connections                     */
+    double   *fan_done;     /* When each receiver's reply was complete, this */
+                            /* one first                                     */
+    long long syscalls;     /* System calls made moving data, -1 if the     */
+                            /* module does not count them                    */
+    int      rxpoll,        /* RX_ mode RecvData() waits for data with, and  */
+             rxusec;        /* ... its busy poll time, spin budget or cap    */
+    int      rxfd;          /* Socket set up for busy polling, -1 if none    */
+    long long rxwait,       /* Mean wait for data, in ns, and the spin       */
+             rxbudget;      /* ... budget it gives the adaptive policy       */
+    long long rxcalls,      /* Receives so far under -J, and those that      */
+             rxblocks;      /* ... ran out of spin budget and blocked        */
     /* Now we work with a union of information for protocol dependent stuff  */
     ProtocolStruct prot;
 };
@@ -328,12 +486,353 @@ struct data
     double t;
     double bps;
     double variance;
+    double tmed;           /* Median trial time                          */
+    double tlo, thi;       /* 95% confidence interval of the median      */
+    int    trials;         /* Number of trials kept after warmup         */
+    double elapsed;        /* Wall time spent on the point               */
+    double joules0,        /* Receiver package 0 and 1 energy over the   */
+           joules1;        /*   last trial, if RAPL is readable          */
+    double work;           /* Length of that energy window in seconds    */
+    double msgrate;        /* Messages per second, in message rate mode  */
+    double offered;        /* Offered load in open-loop mode, per second */
+    double cpu_msg,        /* CPU time per message on this side and on   */
+           peer_cpu_msg;   /*   the other side, -1 if unknown            */
+    double sys_msg,        /* System calls per message on both sides,    */
+           peer_sys_msg;   /*   -1 if the module does not count them     */
+    int    streams;        /* Concurrent streams (-T), 0 if just one     */
+    double jain;           /* Jain fairness index of the streams' rates  */
+    double *stream_bps;    /* Each stream's rate in the fastest trial    */
+    double *stream_comp;   /* ... and mean completion time in incast mode */
+    int    targets;        /* Receivers fanned out to, 0 if just one     */
+    struct hist *target_hist; /* Reply latencies of each of them       */
+    int    load_buf;       /* Bulk socket buffer size (-U), -1 if idle   */
+    double bulk_bps;       /* Rate of the bulk data during the point     */
+    double inflation,      /* Time and 99th percentile over those of the */
+           p99_inflation;  /*   idle curve, 0 if there is none           */
+    int    zerocopy;       /* ZC_ modes of the point, 0 when copying     */
+    double zc_speedup,     /* Time and CPU time per message copying over */
+           zc_cpu,         /*   those of the point, and the share of     */
+           zc_copied,      /*   zero-copy sends the kernel copied anyway */
+           zc_mapped,      /* Share of received bytes mapped, not copied */
+           zc_saved;       /* CPU ns per message saved by both sides, per */
+                           /*   byte of the message                      */
+    int    rx_mode,        /* RX_ mode of the point's receives (-J), and */
+           rx_usec;        /*   its microseconds                         */
+    double rx_gain,        /* Latency gained over blocking in read(), and */
+           rx_cpu;         /*   the CPU ns per message both sides spent more */
+    double rx_budget,      /* Spin budget at the end of the point in ns, */
+           rx_blocked,     /*   the share of receives that blocked, and  */
+           rx_joules;      /*   receiver energy per message, -1 if unknown */
     int    bits;
     int    repeat;
 };
 
+/* Measurements swapped between the two sides at the end of each data
+ * point.  On the wire this is RESULT_VERSION, the number of metrics sent,
+ * then an (id, high word, low word) triple of 32-bit integers per metric,
+ * carried by SendRepeat()/RecvRepeat() so every module supports it.
+ * Later versions may only add ids; unknown ids are skipped.
+ */
+#define  RESULT_VERSION     1
+
+enum metric_ids {
+   MET_TIME_NS,       /* Minimum one-way trial time                 */
+   MET_MEDIAN_NS,     /* Median trial time                          */
+   MET_TRIALS,        /* Trials kept after warmup                   */
+   MET_P50_NS,        /* Per-iteration latency percentiles (-H)     */
+   MET_P99_NS,
+   MET_MAX_NS,
+   MET_WORK_START,    /* Raw timer ticks around the last trial      */
+   MET_WORK_END,
+   MET_WORK_NS,       /* ... and the length of that window          */
+   MET_PKG0_UJ,       /* RAPL package energy over the window        */
+   MET_PKG1_UJ,
+   MET_USER_NS,       /* CPU time used during the data point        */
+   MET_SYS_NS,
+   MET_MSGS,          /* Messages handled during the data point     */
+   MET_SYSCALLS,      /* System calls the module made moving data   */
+   NMETRICS
+};
+
+typedef struct metrics Metrics;
+struct metrics
+{
+    long long val[NMETRICS];
+    char      have[NMETRICS];
+};
+
+/* The transmitter sends the test configuration to the receiver right
+ * after the connection is set up, framed like the metrics above:
+ * CONFIG_VERSION, the number of fields, then (id, high word, low word)
+ * per field.  Times and percentages are sent in units of 1e-9.
+ */
+#define  CONFIG_VERSION     1
+
+enum config_ids {
+   CFG_START, CFG_END, CFG_PERTURBATION, CFG_NREPEAT, CFG_STREAM,
+   CFG_INTEGRITY, CFG_TRIALS, CFG_DISCARD, CFG_WARMUP_N, CFG_HISTOGRAM,
+   CFG_RUNTM, CFG_PRECISION, CFG_BUDGET, CFG_WARMUP_T, CFG_WARMUP_PCT,
+   CFG_CACHE, CFG_SOFFSET, CFG_ROFFSET, CFG_BIDIR, CFG_PREBURST,
+   CFG_RESET_CONN, CFG_LOOPS, CFG_WINDOW, CFG_INFLIGHT, CFG_ORATE,
+   CFG_POISSON, CFG_RESPONSE, CFG_SERVICE, CFG_SERVICE_EXP, CFG_TRACE,
+   CFG_DIST, CFG_DIST_SEED, CFG_STREAMS, CFG_PIN, CFG_INCAST,
+   CFG_LOAD, CFG_ZEROCOPY, CFG_RXPOLL, NCONFIG
+};
+
+/* One message of a replayed trace (-j).  A trace is a text file of
+ * "size gap direction" lines, the gap in microseconds since the previous
+ * message started and the direction > (transmitter to receiver) or <,
+ * or a pcap file of a TCP flow.
+ */
+#define  TRACE_C2S          0      /* Sent by the transmitter              */
+#define  TRACE_S2C          1      /* Sent by the receiver                 */
+
+typedef struct tracerec TraceRec;
+struct tracerec
+{
+    int    size;
+    int    dir;
+    double gap;            /* Seconds since the previous record started  */
+};
+
+/* Message size distributions (-G).  The transmitter draws a table of
+ * NDIST sizes before the run and sends it to the receiver; iteration j
+ * of a trial then uses size j % NDIST on both sides.  Latencies are also
+ * kept per power-of-2 size bucket.
+ */
+#define  NDIST              16384
+#define  NSIZEBKT           32
+
+/* Everything needed to reproduce and identify a run, written with each
+ * structured (JSON or CSV) result.  Cache mode, offsets and bi-directional
+ * mode are taken from the ArgStruct.
+ */
+typedef struct runinfo RunInfo;
+struct runinfo
+{
+    int    start, end,     /* Message size range                         */
+           perturbation,
+           nrepeat,        /* Constant repeat count, 0 if adaptive       */
+           stream,         /* Streaming mode flag                        */
+           integrity,      /* Integrity check flag                       */
+           trials,         /* Trials, or the most trials with precision  */
+           discard,        /* Warmup trials discarded                    */
+           warmup_n,       /* Warmup iterations per point                */
+           histogram,      /* Latency histograms recorded                */
+           timer,          /* TIMER_MONO or TIMER_TSC                    */
+           loops,          /* Times the whole curve is measured (-L)     */
+           loop,           /* Index of the current loop                  */
+           winmax,         /* Largest window of the window sweep (-W)    */
+           window,         /* Window of the current curve, 0 if none     */
+           inflight,       /* Messages in flight in rate mode (-M)       */
+           poisson,        /* Poisson instead of constant arrivals (-Q)  */
+           response,       /* Response size, 0 to echo the request (-y)  */
+           service_exp,    /* Service times are exponential (-x)         */
+           trace,          /* Records of the replayed trace (-j)         */
+           dist,           /* Sizes in the drawn size table (-G)         */
+           dist_seed,      /* ... and the seed they were drawn with      */
+           streams,        /* Concurrent streams (-T), 0 if just one     */
+           pin,            /* Stream threads are pinned to cores         */
+           incast,         /* The streams are incast senders (-V)        */
+           load,           /* Bulk socket buffer sizes swept (-U)        */
+           zerocopy,       /* ZC_ modes compared with copying (-Z)       */
+           rxpoll;         /* Receive policies compared with blocking (-J) */
+    double orate,          /* First offered load of open-loop mode (-Q)  */
+           service,        /* (Mean) receiver service time per request   */
+           runtm,          /* Target trial run time                      */
+           precision,      /* Median CI target in percent, 0 if fixed    */
+           budget,         /* Time budget per point                      */
+           warmup_t,       /* Warmup seconds per point                   */
+           warmup_pct;     /* Warmup stability target in percent         */
+
+    char   hostname[256], kernel[256], cpu[256];
+    int    ncpus;
+    char   sysctl[NSYSCTL][64];
+};
+
+/* Log-bucketed (HDR-style) latency histogram.  Values are recorded in
+ * nanoseconds; each power of 2 is split into HIST_SUB linear buckets, so
+ * any recorded value is known to within 1/HIST_SUB of itself.
+ */
+typedef struct hist Hist;
+struct hist
+{
+    long long count[HIST_NBINS];
+    long long total;
+    double    sum, sumsq;   /* Exact sums in seconds for mean/variance */
+    double    max;
+};
+
+/* The best of the loops of a base curve (idle, copying or blocking),
+ * point by point, that the curves after it are compared with.
+ */
+typedef struct basecurve BaseCurve;
+struct basecurve
+{
+    double *t,             /* Time of each point                         */
+           *p99,           /* ... its 99th percentile latency            */
+           *cpu,           /* ... CPU time per message, both sides' (-J) */
+           *peer;          /* ... and the other side's                   */
+};
+
+/* The curves a run measures one after the other, each loops times: one
+ * per window (-W), number of incast senders (-V), bulk load (-U), with
+ * and without copying (-Z) and receive policy (-J).  Each field pair is
+ * the current curve and the last one of its kind.
+ */
+typedef struct pass Pass;
+struct pass
+{
+    int    window, winmax, /* Messages in flight, 0 unless windowed      */
+           nsend, maxsend, /* Streams used, incast senders up to maxsend */
+           load, nload,    /* Bulk load from 1, or 0 for idle            */
+           zerocopy, zcopt,/* Zero-copy curve set, and its ZC_ modes     */
+           policy, npoll;  /* Receive policy from 1, or 0 for blocking   */
+#if defined(BULKLOAD)
+    int    loadbuf[MAXLOAD];/* Bulk socket buffer sizes                  */
+#endif
+#if defined(RXPOLL)
+    int    rxpol[MAXPOLL]; /* Receive policies, RX_POLICY()              */
+    double rxsum[MAXPOLL+1][5];/* Sums of p50, p99, J/msg, extra CPU and  */
+                           /* blocked share of each policy's points      */
+    int    rxpts[MAXPOLL+1];/* ... and the points summed                 */
+#endif
+    BaseCurve idle,        /* Points of the idle curve under -U          */
+           copy,           /* ... the copying one under -Z               */
+           block;          /* ... and the blocking one under -J          */
+};
+
 double When();
 
+void TimerInit(int backend);
+
+unsigned long long ReadTicks();
+
+double TicksToSec(unsigned long long ticks);
+
+extern double timer_overhead;  /* Cost of one When() call, in seconds */
+
+void HistReset(Hist *h);
+
+void HistAdd(Hist *h, double t);
+
+double HistPercentile(Hist *h, double pct);
+
+double HistMean(Hist *h);
+
+int MedianCI(double *x, int n, double *med, double *lo, double *hi);
+
+void LoopSummary(FILE *out, Data *d, int npts, double *loop_t, int loops);
+
+void BaseAlloc(BaseCurve *b);
+
+void PassStart(ArgStruct *p, Pass *ps);
+
+int  NextPass(Pass *ps);
+
+void PassLabel(FILE *out, Pass *ps);
+
+void CompareLoad(Pass *ps, Data *d, int n, int first, double p99);
+
+void CompareZeroCopy(Pass *ps, Data *d, int n, int first, int bufflen);
+
+void ComparePolicy(Pass *ps, Data *d, int n, int first, Hist *h);
+
+void ZeroCopySummary(FILE *out, Data *d, int n);
+
+void RecvResponse(ArgStruct *p, int response);
+
+void SendResponse(ArgStruct *p, int response);
+
+void ServiceTime(double mean, int exponential);
+
+int  ReadTrace(char *file, TraceRec **trace);
+
+void SendTrace(ArgStruct *p, TraceRec *trace, int n);
+
+int  RecvTrace(ArgStruct *p, TraceRec **trace, int n);
+
+void Replay(ArgStruct *p, TraceRec *trace, int n, double *lat);
+
+int  DrawSizes(char *spec, int seed, int n, int **sizes);
+
+void SendSizes(ArgStruct *p, int *sizes, int n);
+
+int  RecvSizes(ArgStruct *p, int **sizes, int n);
+
+int  SizeBucket(int size);
+
+#if defined(OPENLOOP)
+void OpenLoop(ArgStruct *p, int n, double rate, int poisson, int response,
+              Hist *h);
+#endif
+
+#if defined(MULTISTREAM)
+ArgStruct *OpenStreams(ArgStruct *p, int n);
+
+void CloseStreams(ArgStruct *st, int n);
+
+void MultiStream(ArgStruct *st, int n, int bufflen, int nrepeat, int stream,
+                 int response, double service, int service_exp, int pin,
+                 double *t);
+#endif
+
+#if defined(BULKLOAD)
+/* Bulk data streaming on a second connection while the first one is
+ * measured.  The transmitter's thread writes for as long as it runs,
+ * the receiver's reads until the transmitter shuts the connection down.
+ */
+typedef struct bulkload
+{
+    ArgStruct          a;
+    pthread_t          th;
+    char               *buf;
+    volatile int       stop;
+    volatile long long bytes;   /* Sent or received so far          */
+} BulkLoad;
+
+BulkLoad *BulkStart(ArgStruct *p, int sockbuf);
+
+void BulkStop(BulkLoad *b);
+#endif
+
+#if defined(INCAST)
+double Incast(ArgStruct *st, int n, int bufflen, int nrepeat, int pin,
+              double *lat, double *comp);
+#endif
+
+void GetHostInfo(RunInfo *ri);
+
+void WriteHeader(FILE *out, int format);
+
+void WriteResult(FILE *out, int format, RunInfo *ri, ArgStruct *p,
+                 Data *d, double *trial_t, Hist *h,
+                 Metrics *local, Metrics *remote);
+
+void MetricsReset(Metrics *m);
+
+void MetricSet(Metrics *m, int id, long long val);
+
+void SendMetrics(ArgStruct *p, Metrics *m);
+
+void RecvMetrics(ArgStruct *p, Metrics *m);
+
+void SendConfig(ArgStruct *p, RunInfo *ri);
+
+int  RecvConfig(ArgStruct *p, RunInfo *ri);
+
+double HistVariance(Hist *h);
+
+#if defined(RXPOLL)
+void PrintPolicy(FILE *out, int policy);
+
+void SetRecvPolicy(ArgStruct *p, int policy);
+
+int  RecvPolled(ArgStruct *p, char *buf, int len);
+
+void PolicySummary(FILE *out, Pass *ps);
+#endif
+
 void Init(ArgStruct *p, int* argc, char*** argv);
 
 void Setup(ArgStruct *p);
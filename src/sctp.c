@@ -205,6 +205,21 @@ void RecvData(ArgStruct *p)
     int bytesRead;
     char *q;
 
+#if defined(RXPOLL)
+    if (p->rxpoll != RX_BLOCK)
+      {
+        bytesRead = RecvPolled(p, p->r_ptr, p->bufflen);
+        if (bytesRead < 0)
+          {
+            printf("NetPIPE: recv: error encountered, errno=%d\n", errno);
+            exit(401);
+          }
+        if (bytesRead < p->bufflen)
+          printf("NetPIPE: \"end of file\" encountered on reading from socket\n");
+        return;
+      }
+#endif
+
     bytesLeft = p->bufflen;
     bytesRead = 0;
     q = p->r_ptr;
@@ -230,17 +245,18 @@ void RecvData(ArgStruct *p)
 
 void SendTime(ArgStruct *p, double *t)
 {
-    uint32_t ltime, ntime;
+    uint64_t ltime;
+    uint32_t ntime[2];
 
     /*
-      Multiply the number of seconds by 1e8 to get time in 0.01 microseconds
-      and convert value to an unsigned 32-bit integer.
+      Send the number of seconds as a 64-bit count of nanoseconds, so
+      long trials do not overflow, high word first in network order.
       */
-    ltime = (uint32_t)(*t * 1.e8);
+    ltime = (uint64_t)(*t * 1.e9 + 0.5);
+    ntime[0] = htonl((uint32_t)(ltime >> 32));
+    ntime[1] = htonl((uint32_t)ltime);
 
-    /* Send time in network order */
-    ntime = htonl(ltime);
-    if (write(p->commfd, (char *)&ntime, sizeof(uint32_t)) < 0)
+    if (write(p->commfd, (char *)ntime, sizeof(ntime)) < 0)
       {
         printf("NetPIPE: write failed in SendTime: errno=%d\n", errno);
         exit(301);
@@ -249,26 +265,27 @@ void SendTime(ArgStruct *p, double *t)
 
 void RecvTime(ArgStruct *p, double *t)
 {
-    uint32_t ltime, ntime;
+    uint64_t ltime;
+    uint32_t ntime[2];
     int bytesRead;
 
-    bytesRead = readFully(p->commfd, (void *)&ntime, sizeof(uint32_t));
+    bytesRead = readFully(p->commfd, (void *)ntime, sizeof(ntime));
     if (bytesRead < 0)
       {
         printf("NetPIPE: read failed in RecvTime: errno=%d\n", errno);
         exit(302);
       }
-    else if (bytesRead != sizeof(uint32_t))
+    else if (bytesRead != sizeof(ntime))
       {
         fprintf(stderr, "NetPIPE: partial read in RecvTime of %d bytes\n",
                 bytesRead);
         exit(303);
       }
-    ltime = ntohl(ntime);
+    ltime = ((uint64_t)ntohl(ntime[0]) << 32) | ntohl(ntime[1]);
 
-        /* Result is ltime (in microseconds) divided by 1.0e8 to get seconds */
+        /* Result is ltime (in nanoseconds) divided by 1.0e9 to get seconds */
 
-    *t = (double)ltime / 1.0e8;
+    *t = (double)ltime / 1.0e9;
 }
 
 void SendRepeat(ArgStruct *p, int rpt)
@@ -314,6 +331,7 @@ void establish(ArgStruct *p)
   struct protoent *proto;
 
   clen = (socklen_t) sizeof(p->prot.sin2);
+  p->rxfd = -1;           /* Busy polling (-J) is set on the new socket */
 
   if( p->tr ){
 
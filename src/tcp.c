@@ -24,6 +24,16 @@ void Init(ArgStruct *p, int* pargc, char*** pargv)
 {
    p->reset_conn = 0; /* Default to not resetting connection */
    p->prot.sndbufsz = p->prot.rcvbufsz = 0;
+#if defined(ZEROCOPY)
+   p->prot.zerocopy = p->prot.zc_on = 0;
+   p->prot.zc_sent = p->prot.zc_done = p->prot.zc_copied = 0;
+#endif
+#if defined(ZC_RECV)
+   p->prot.zc_map = NULL;
+   p->prot.zc_maplen = 0;
+   p->prot.zc_rbytes = p->prot.zc_mapped = 0;
+#endif
+   p->syscalls = 0;
    p->tr = 0;     /* The transmitter will be set using the -h host flag. */
    p->rcv = 1;
 }
@@ -129,6 +139,12 @@ void Setup(ArgStruct *p)
    lsin1->sin_family      = AF_INET;
    lsin1->sin_addr.s_addr = htonl(INADDR_ANY);
    lsin1->sin_port        = htons(p->port);
+
+   /* Allow a quick restart while old connections sit in TIME_WAIT */
+   if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(int))) {
+     printf("NetPIPE: server: unable to setsockopt -- errno %d\n", errno);
+     exit(557);
+   }
    
    if (bind(sockfd, (struct sockaddr *) lsin1, sizeof(*lsin1)) < 0){
      printf("NetPIPE: server: bind on local address failed! errno=%d", errno);
@@ -144,14 +160,14 @@ void Setup(ArgStruct *p)
 }   
 
 static int
-readFully(int fd, void *obuf, int len)
+readFully(ArgStruct *p, void *obuf, int len)
 {
   int bytesLeft = len;
   char *buf = (char *) obuf;
   int bytesRead = 0;
 
   while (bytesLeft > 0 &&
-         (bytesRead = read(fd, (void *) buf, bytesLeft)) > 0)
+         (p->syscalls++, bytesRead = read(p->commfd, (void *) buf, bytesLeft)) > 0)
     {
       bytesLeft -= bytesRead;
       buf += bytesRead;
@@ -163,9 +179,11 @@ readFully(int fd, void *obuf, int len)
 void Sync(ArgStruct *p)
 {
     char s[] = "SyncMe", response[] = "      ";
+    int i;
 
+    p->syscalls++;
     if (write(p->commfd, s, strlen(s)) < 0 ||           /* Write to nbor */
-        readFully(p->commfd, response, strlen(s)) < 0)  /* Read from nbor */
+        readFully(p, response, strlen(s)) < 0)  /* Read from nbor */
       {
         perror("NetPIPE: error writing or reading synchronization string");
         exit(3);
@@ -175,6 +193,12 @@ void Sync(ArgStruct *p)
         fprintf(stderr, "NetPIPE: Synchronization string incorrect! |%s|\n", response);
         exit(3);
       }
+
+    /* Everything the transmitter sends also goes to the receivers it
+     * fans out to, so each of them follows the test like the first.
+     */
+    for (i = 0; i < p->nfan; i++)
+      Sync(&p->fan[i]);
 }
 
 void PrepareToReceive(ArgStruct *p)
@@ -185,16 +209,108 @@ void PrepareToReceive(ArgStruct *p)
         */
 }
 
+#if defined(ZEROCOPY)
+
+/* Reap zero-copy completions from the socket error queue until the kernel
+ * has released the buffers of all sends before number upto.  Each
+ * notification covers a range of sends, flagged if the kernel copied
+ * their data after all, as it does over loopback.
+ */
+static void ZeroCopyReap(ArgStruct *p, unsigned int upto)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+    struct pollfd pfd;
+    unsigned int n;
+
+    while ((int)(upto - p->prot.zc_done) > 0)
+      {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        p->syscalls++;
+        if (recvmsg(p->commfd, &msg, MSG_ERRQUEUE) < 0)
+          {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+              {
+                printf("NetPIPE: recvmsg: error reaping zero-copy sends, errno=%d\n", errno);
+                exit(401);
+              }
+            pfd.fd = p->commfd;
+            pfd.events = 0;     /* POLLERR is always reported */
+            p->syscalls++;
+            poll(&pfd, 1, -1);
+            continue;
+          }
+        for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+          {
+            /* Only IP error messages hold a sock_extended_err */
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+              continue;
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+              continue;
+            n = serr->ee_data - serr->ee_info + 1;
+            p->prot.zc_done += n;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+              p->prot.zc_copied += n;
+          }
+      }
+}
+
+#endif
+
+/* Write as much of len bytes at q as the socket takes.  Sending with
+ * MSG_ZEROCOPY, the kernel reads q until it releases it, so the buffer
+ * may be sent again but not written before ZeroCopyReap().
+ */
+static int SendChunk(ArgStruct *p, char *q, int len)
+{
+#if defined(ZEROCOPY)
+    int one = 1, n;
+
+    if (p->prot.zerocopy & ZC_SEND)
+      {
+        if (!p->prot.zc_on)
+          {
+            if (setsockopt(p->commfd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+              {
+                printf("NetPIPE: setsockopt: SO_ZEROCOPY failed! errno=%d\n", errno);
+                exit(556);
+              }
+            p->prot.zc_on = 1;
+          }
+
+        /* With too many sends in flight, wait for one to be released,
+         * or copy if none is outstanding.
+         */
+        while ((n = send(p->commfd, q, len, MSG_ZEROCOPY)) < 0 && errno == ENOBUFS)
+          {
+            if (p->prot.zc_done == p->prot.zc_sent)
+              return write(p->commfd, q, len);
+            ZeroCopyReap(p, p->prot.zc_done + 1);
+          }
+        if (n > 0)
+          p->prot.zc_sent++;
+        return n;
+      }
+#endif
+    return write(p->commfd, q, len);
+}
+
 void SendData(ArgStruct *p)
 {
-    int bytesWritten, bytesLeft;
+    int bytesWritten, bytesLeft, i;
     char *q;
 
     bytesLeft = p->bufflen;
     bytesWritten = 0;
     q = p->s_ptr;
     while (bytesLeft > 0 &&
-           (bytesWritten = write(p->commfd, q, bytesLeft)) > 0)
+           (p->syscalls++, bytesWritten = SendChunk(p, q, bytesLeft)) > 0)
       {
         bytesLeft -= bytesWritten;
         q += bytesWritten;
@@ -204,19 +320,200 @@ void SendData(ArgStruct *p)
         printf("NetPIPE: write: error encountered, errno=%d\n", errno);
         exit(401);
       }
+
+    for (i = 0; i < p->nfan; i++)
+      {
+        p->fan[i].s_ptr = p->s_ptr;
+        p->fan[i].bufflen = p->bufflen;
+        SendData(&p->fan[i]);
+      }
+}
+
+/* Receive the reply of the first receiver and of every one fanned out
+ * to, in whatever order they arrive, all into the same buffer, and note
+ * when each was complete.
+ */
+static void RecvFanout(ArgStruct *p)
+{
+    struct pollfd fds[MAXFAN+1];
+    int got[MAXFAN+1], n = p->nfan + 1, left = n, i;
+    ssize_t bytesRead;
+
+    for (i = 0; i < n; i++)
+      {
+        fds[i].fd = i ? p->fan[i-1].commfd : p->commfd;
+        fds[i].events = POLLIN;
+        got[i] = 0;
+      }
+    while (left > 0)
+      {
+        p->syscalls++;
+        if (poll(fds, n, -1) < 0)
+          {
+            if (errno == EINTR) continue;
+            printf("NetPIPE: poll: error encountered, errno=%d\n", errno);
+            exit(401);
+          }
+        for (i = 0; i < n; i++)
+          {
+            if (fds[i].fd < 0 || !fds[i].revents) continue;
+            p->syscalls++;
+            bytesRead = read(fds[i].fd, p->r_ptr + got[i], p->bufflen - got[i]);
+            if (bytesRead <= 0)
+              {
+                printf("NetPIPE: read: error encountered from receiver %d, errno=%d\n",
+                       i, errno);
+                exit(401);
+              }
+            if ((got[i] += bytesRead) == p->bufflen)
+              {
+                p->fan_done[i] = When();
+                fds[i].fd = -1;      /* poll() skips it from now on */
+                left--;
+              }
+          }
+      }
+}
+
+#if defined(ZC_RECV)
+
+/* Receive len bytes, mapping the whole pages among them into the socket's
+ * mapping with TCP_ZEROCOPY_RECEIVE, which replaces the pages mapped for
+ * the message before.  What the kernel can't map, such as data not in
+ * whole pages and the tail short of a page, is read into q at its offset
+ * in the message.  Once such a copy leaves the stream off a page boundary,
+ * the pages mapped next go after those mapped so far, not at their offset
+ * in the message, so they don't replace them.
+ */
+static void RecvMapped(ArgStruct *p, char *q, int len)
+{
+    struct tcp_zerocopy_receive zc;
+    socklen_t zclen;
+    struct pollfd pfd;
+    long page = sysconf(_SC_PAGESIZE);
+    size_t maplen = ((size_t)len + page - 1) & ~(size_t)(page - 1);
+    int got = 0, off = 0, n, mapped;     /* Bytes received, and mapped */
+
+    if (maplen > p->prot.zc_maplen)
+      {
+        if (p->prot.zc_map != NULL)
+          munmap(p->prot.zc_map, p->prot.zc_maplen);
+        p->prot.zc_map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, p->commfd, 0);
+        if (p->prot.zc_map == MAP_FAILED)
+          {
+            printf("NetPIPE: mmap of the socket failed! errno=%d\n", errno);
+            exit(556);
+          }
+        p->prot.zc_maplen = maplen;
+      }
+
+    while (got < len)
+      {
+        mapped = 0;
+        if ((n = (len - got) & ~(page - 1)) > 0)
+          {
+            memset(&zc, 0, sizeof(zc));
+            zc.address = (uint64_t)(uintptr_t)(p->prot.zc_map + off);
+            zc.length = n;
+            zclen = sizeof(zc);
+            p->syscalls++;
+            if (getsockopt(p->commfd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE,
+                           &zc, &zclen) < 0)
+              {
+                printf("NetPIPE: getsockopt: TCP_ZEROCOPY_RECEIVE failed! errno=%d\n", errno);
+                exit(401);
+              }
+            mapped = zc.length;
+            got += mapped;
+            off += mapped;
+            p->prot.zc_mapped += mapped;
+            n = MIN(zc.recv_skip_hint, len - got);
+          }
+        else
+          n = len - got;
+
+        if (n > 0)
+          {
+            if (readFully(p, q + got, n) != n)
+              {
+                printf("NetPIPE: read: error encountered, errno=%d\n", errno);
+                exit(401);
+              }
+            got += n;
+          }
+        else if (!mapped)
+          {
+            pfd.fd = p->commfd;      /* Nothing queued yet */
+            pfd.events = POLLIN;
+            p->syscalls++;
+            poll(&pfd, 1, -1);
+          }
+      }
+    p->prot.zc_rbytes += len;
 }
 
+#endif
+
+#if defined(ZEROCOPY)
+
+/* Wait for the zero-copy sends and drop the received pages before the
+ * socket is closed.
+ */
+static void ZeroCopyClose(ArgStruct *p)
+{
+    ZeroCopyReap(p, p->prot.zc_sent);
+#if defined(ZC_RECV)
+    if (p->prot.zc_map != NULL)
+      munmap(p->prot.zc_map, p->prot.zc_maplen);
+    p->prot.zc_map = NULL;
+    p->prot.zc_maplen = 0;
+#endif
+}
+
+#endif
+
 void RecvData(ArgStruct *p)
 {
     int bytesLeft;
     int bytesRead;
     char *q;
 
+    if (p->nfan > 0)
+      {
+        RecvFanout(p);
+        return;
+      }
+
+#if defined(ZEROCOPY)
+    ZeroCopyReap(p, p->prot.zc_sent);   /* The buffer may be the one sent */
+#endif
+#if defined(ZC_RECV)
+    if (p->prot.zerocopy & ZC_RECV)
+      {
+        RecvMapped(p, p->r_ptr, p->bufflen);
+        return;
+      }
+#endif
+#if defined(RXPOLL)
+    if (p->rxpoll != RX_BLOCK)
+      {
+        bytesRead = RecvPolled(p, p->r_ptr, p->bufflen);
+        if (bytesRead < 0)
+          {
+            printf("NetPIPE: recv: error encountered, errno=%d\n", errno);
+            exit(401);
+          }
+        if (bytesRead < p->bufflen)
+          printf("NetPIPE: \"end of file\" encountered on reading from socket\n");
+        return;
+      }
+#endif
+
     bytesLeft = p->bufflen;
     bytesRead = 0;
     q = p->r_ptr;
     while (bytesLeft > 0 &&
-           (bytesRead = read(p->commfd, q, bytesLeft)) > 0)
+           (p->syscalls++, bytesRead = read(p->commfd, q, bytesLeft)) > 0)
       {
         bytesLeft -= bytesRead;
         q += bytesRead;
@@ -237,17 +534,19 @@ void RecvData(ArgStruct *p)
 
 void SendTime(ArgStruct *p, double *t)
 {
-    uint32_t ltime, ntime;
+    uint64_t ltime;
+    uint32_t ntime[2];
 
     /*
-      Multiply the number of seconds by 1e8 to get time in 0.01 microseconds
-      and convert value to an unsigned 32-bit integer.
+      Send the number of seconds as a 64-bit count of nanoseconds, so
+      long trials do not overflow, high word first in network order.
       */
-    ltime = (uint32_t)(*t * 1.e8);
+    ltime = (uint64_t)(*t * 1.e9 + 0.5);
+    ntime[0] = htonl((uint32_t)(ltime >> 32));
+    ntime[1] = htonl((uint32_t)ltime);
 
-    /* Send time in network order */
-    ntime = htonl(ltime);
-    if (write(p->commfd, (char *)&ntime, sizeof(uint32_t)) < 0)
+    p->syscalls++;
+    if (write(p->commfd, (char *)ntime, sizeof(ntime)) < 0)
       {
         printf("NetPIPE: write failed in SendTime: errno=%d\n", errno);
         exit(301);
@@ -256,40 +555,49 @@ void SendTime(ArgStruct *p, double *t)
 
 void RecvTime(ArgStruct *p, double *t)
 {
-    uint32_t ltime, ntime;
+    uint64_t ltime;
+    uint32_t ntime[2];
     int bytesRead;
 
-    bytesRead = readFully(p->commfd, (void *)&ntime, sizeof(uint32_t));
+    bytesRead = readFully(p, (void *)ntime, sizeof(ntime));
     if (bytesRead < 0)
       {
         printf("NetPIPE: read failed in RecvTime: errno=%d\n", errno);
         exit(302);
       }
-    else if (bytesRead != sizeof(uint32_t))
+    else if (bytesRead != sizeof(ntime))
       {
         fprintf(stderr, "NetPIPE: partial read in RecvTime of %d bytes\n",
                 bytesRead);
         exit(303);
       }
-    ltime = ntohl(ntime);
+    ltime = ((uint64_t)ntohl(ntime[0]) << 32) | ntohl(ntime[1]);
 
-        /* Result is ltime (in microseconds) divided by 1.0e8 to get seconds */
+        /* Result is ltime (in nanoseconds) divided by 1.0e9 to get seconds */
 
-    *t = (double)ltime / 1.0e8;
+    *t = (double)ltime / 1.0e9;
 }
 
 void SendRepeat(ArgStruct *p, int rpt)
 {
   uint32_t lrpt, nrpt;
+  int i;
 
   lrpt = rpt;
   /* Send repeat count as a long in network order */
   nrpt = htonl(lrpt);
+  p->syscalls++;
   if (write(p->commfd, (void *) &nrpt, sizeof(uint32_t)) < 0)
     {
       printf("NetPIPE: write failed in SendRepeat: errno=%d\n", errno);
       exit(304);
     }
+
+  /* RecvRepeat() reads only the first receiver, so the driver drains
+   * the others where it expects an answer from them.
+   */
+  for (i = 0; i < p->nfan; i++)
+    SendRepeat(&p->fan[i], rpt);
 }
 
 void RecvRepeat(ArgStruct *p, int *rpt)
@@ -297,7 +605,7 @@ void RecvRepeat(ArgStruct *p, int *rpt)
   uint32_t lrpt, nrpt;
   int bytesRead;
 
-  bytesRead = readFully(p->commfd, (void *)&nrpt, sizeof(uint32_t));
+  bytesRead = readFully(p, (void *)&nrpt, sizeof(uint32_t));
   if (bytesRead < 0)
     {
       printf("NetPIPE: read failed in RecvRepeat: errno=%d\n", errno);
@@ -322,17 +630,22 @@ void establish(ArgStruct *p)
 
   clen = (socklen_t) sizeof(p->prot.sin2);
 
+#if defined(ZEROCOPY)
+  p->prot.zc_on = 0;      /* SO_ZEROCOPY is set again on the new socket */
+#endif
+  p->rxfd = -1;           /* ... and so is busy polling (-J) */
+
   if( p->tr ){
 
     while( connect(p->commfd, (struct sockaddr *) &(p->prot.sin1),
                    sizeof(p->prot.sin1)) < 0 ) {
 
-      /* If we are doing a reset and we get a connection refused from
-       * the connect() call, assume that the other node has not yet
-       * gotten to its corresponding accept() call and keep trying until
-       * we have success.
+      /* If we are doing a reset, or connecting an extra stream, and we
+       * get a connection refused from the connect() call, assume that
+       * the other node has not yet gotten to its corresponding accept()
+       * call and keep trying until we have success.
        */
-      if(!doing_reset || errno != ECONNREFUSED) {
+      if((!doing_reset && !p->connect_retry) || errno != ECONNREFUSED) {
         printf("Client: Cannot Connect! errno=%d\n",errno);
         exit(-10);
       } 
@@ -394,7 +707,12 @@ void establish(ArgStruct *p)
 
 void CleanUp(ArgStruct *p)
 {
-   char *quit="QUIT";
+   char quit[5] = "QUIT";
+   int i;
+
+#if defined(ZEROCOPY)
+   ZeroCopyClose(p);
+#endif
 
    if (p->tr) {
 
@@ -402,6 +720,9 @@ void CleanUp(ArgStruct *p)
       read(p->commfd, quit, 5);
       close(p->commfd);
 
+      for (i = 0; i < p->nfan; i++)
+        CleanUp(&p->fan[i]);
+
    } else if( p->rcv ) {
 
       read(p->commfd,quit, 5);
@@ -415,6 +736,12 @@ void CleanUp(ArgStruct *p)
 
 void Reset(ArgStruct *p)
 {
+#if defined(ZEROCOPY)
+  /* Buffers still held by zero-copy sends are written or freed between
+   * trials, and their completions are lost with the socket.
+   */
+  ZeroCopyReap(p, p->prot.zc_sent);
+#endif
   
   /* Reset sockets */
 
@@ -422,13 +749,35 @@ void Reset(ArgStruct *p)
 
     doing_reset = 1;
 
-    /* Close the sockets */
+    if (p->tr) {
+
+      /* Close the socket */
+
+      CleanUp(p);
+
+      /* Now open and connect a new socket */
 
-    CleanUp(p);
+      Setup(p);
 
-    /* Now open and connect new sockets */
+    } else if (p->rcv) {
 
-    Setup(p);
+      char quit[5];
+
+      /* Keep the listening socket open so the transmitter can never
+       * connect to a listener that is about to be closed, and just
+       * accept the next connection on it.
+       */
+
+      read(p->commfd, quit, 5);
+      write(p->commfd, quit, 5);
+#if defined(ZEROCOPY)
+      ZeroCopyClose(p);
+#endif
+      close(p->commfd);
+
+      establish(p);
+
+    }
 
   }
 
@@ -0,0 +1,884 @@
+/*****************************************************************************/
+/* "NetPIPE" -- Network Protocol Independent Performance Evaluator.          */
+/* Copyright 1997, 1998 Iowa State University Research Foundation, Inc.      */
+/*                                                                           */
+/* This program is free software; you can redistribute it and/or modify      */
+/* it under the terms of the GNU General Public License as published by      */
+/* the Free Software Foundation.  You should have received a copy of the     */
+/* GNU General Public License along with this program; if not, write to the  */
+/* Free Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.   */
+/*                                                                           */
+/*     * uring.c            ---- TCP sockets driven through io_uring         */
+/*****************************************************************************/
+#include    "netpipe.h"
+
+/* The socket is set up as in tcp.c, then all data, control messages
+ * included, goes through an io_uring: the socket is the ring's only
+ * fixed file, sends come from the buffers of MyMalloc() registered with
+ * the ring, and a multishot receive fills buffers of a provided buffer
+ * ring, copied out as RecvData() asks for them.  A send is only queued;
+ * the io_uring_enter() that waits for the next data submits it too.
+ * With -q a kernel thread polls the submission queue and completions
+ * are polled for, so the data path makes no system calls at all.
+ */
+
+#define UD_RECV    1        /* user_data of the multishot receive */
+#define UD_SEND    2        /* ... of the send in flight          */
+#define UD_CANCEL  3        /* ... and of its cancellation        */
+
+int doing_reset = 0;
+
+/* Buffers registered by MyMalloc(), kept to register them again with
+ * the ring of a new connection.
+ */
+static struct iovec reg[2];
+static int nreg = 0;
+static ArgStruct *owner = NULL;
+
+static int UringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int UringRegister(ArgStruct *p, unsigned op, void *arg, unsigned n)
+{
+    return (int) syscall(__NR_io_uring_register, p->prot.ring_fd, op, arg, n);
+}
+
+void Init(ArgStruct *p, int* pargc, char*** pargv)
+{
+   p->reset_conn = 0; /* Default to not resetting connection */
+   p->prot.sndbufsz = p->prot.rcvbufsz = 0;
+   p->prot.sqpoll = 0;
+   p->prot.ring_fd = -1;
+   p->syscalls = 0;
+   p->tr = 0;     /* The transmitter will be set using the -h host flag. */
+   p->rcv = 1;
+}
+
+/* Make the submissions queued since the last call visible to the kernel,
+ * and with wait, sleep until there are at least wait completions.  With
+ * SQPOLL the kernel thread takes the submissions, and only needs a
+ * system call to wake it once it went idle.
+ */
+static void UringEnter(ArgStruct *p, unsigned wait)
+{
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+
+    if (p->prot.sqpoll)
+      {
+        if (p->prot.to_submit > 0)
+          {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(p->prot.sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP)
+              {
+                syscall(__NR_io_uring_enter, p->prot.ring_fd, 0, 0,
+                        IORING_ENTER_SQ_WAKEUP, NULL, 0);
+                p->syscalls++;
+              }
+            p->prot.to_submit = 0;
+          }
+        while (wait > 0 &&
+               __atomic_load_n(p->prot.cq_tail, __ATOMIC_ACQUIRE) - *p->prot.cq_head < wait)
+          ;
+        return;
+      }
+
+    if (p->prot.to_submit == 0 && wait == 0)
+      return;
+    for (;;)
+      {
+        p->syscalls++;
+        if (syscall(__NR_io_uring_enter, p->prot.ring_fd, p->prot.to_submit,
+                    wait, flags, NULL, 0) >= 0)
+          break;
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN || errno == EBUSY)   /* Completions to reap first */
+          break;
+        printf("NetPIPE: io_uring_enter failed! errno=%d\n", errno);
+        exit(401);
+      }
+    p->prot.to_submit = 0;
+}
+
+/* Get the next free submission queue entry, cleared */
+static struct io_uring_sqe *UringSqe(ArgStruct *p)
+{
+    unsigned tail = p->prot.sq_local, idx;
+    struct io_uring_sqe *sqe;
+
+    while (tail - __atomic_load_n(p->prot.sq_head, __ATOMIC_ACQUIRE) >= *p->prot.sq_entries)
+      UringEnter(p, 0);
+    idx = tail & *p->prot.sq_mask;
+    sqe = &p->prot.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    p->prot.sq_array[idx] = idx;
+    return sqe;
+}
+
+/* Queue the entry UringSqe() returned */
+static void UringPush(ArgStruct *p)
+{
+    __atomic_store_n(p->prot.sq_tail, ++p->prot.sq_local, __ATOMIC_RELEASE);
+    p->prot.to_submit++;
+    if (p->prot.sqpoll)
+      UringEnter(p, 0);
+}
+
+/* Hand buffer bid back to the provided buffer ring */
+static void UringRecycle(ArgStruct *p, int bid)
+{
+    struct io_uring_buf *b;
+
+    b = &p->prot.br->bufs[p->prot.br_tail & (URING_NBUF - 1)];
+    b->addr = (unsigned long) (p->prot.bufs + (size_t)bid * URING_BUFSZ);
+    b->len = URING_BUFSZ;
+    b->bid = bid;
+    __atomic_store_n(&p->prot.br->tail, ++p->prot.br_tail, __ATOMIC_RELEASE);
+}
+
+/* Post the multishot receive.  It ends when the provided buffers run
+ * out, and is posted again once some are recycled.
+ */
+static void UringArm(ArgStruct *p)
+{
+    struct io_uring_sqe *sqe = UringSqe(p);
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = 0;                                 /* Fixed file 0 */
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    sqe->user_data = UD_RECV;
+    UringPush(p);
+    p->prot.armed = 1;
+}
+
+/* Queue a send of the rest of the message in flight.  MSG_WAITALL has
+ * the kernel retry until all of it is sent, so the send and the reply
+ * can be waited for together.  Messages larger than a receive buffer
+ * take several waits anyway, and are written from the registered buffer
+ * holding them with IORING_OP_WRITE_FIXED, which may come back short.
+ */
+static void UringSend(ArgStruct *p)
+{
+    struct io_uring_sqe *sqe = UringSqe(p);
+    int i;
+
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = 0;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (unsigned long) p->prot.s_next;
+    sqe->len = p->prot.s_left;
+    sqe->msg_flags = MSG_WAITALL;
+    sqe->user_data = UD_SEND;
+    p->prot.s_fixed = 0;
+    for (i = 0; p->prot.fixed && p->prot.s_left > URING_BUFSZ && i < nreg; i++)
+      if (p->prot.s_next >= (char *)reg[i].iov_base &&
+          p->prot.s_next + p->prot.s_left <= (char *)reg[i].iov_base + reg[i].iov_len)
+        {
+          sqe->opcode = IORING_OP_WRITE_FIXED;
+          sqe->msg_flags = 0;
+          sqe->buf_index = i;
+          p->prot.s_fixed = 1;
+          break;
+        }
+    UringPush(p);
+    p->prot.sending = 1;
+}
+
+/* Take in all completions there are */
+static void UringReap(ArgStruct *p)
+{
+    unsigned head = *p->prot.cq_head, n;
+    struct io_uring_cqe *cqe;
+
+    while (head != __atomic_load_n(p->prot.cq_tail, __ATOMIC_ACQUIRE))
+      {
+        cqe = &p->prot.cqes[head & *p->prot.cq_mask];
+        if (cqe->user_data == UD_RECV)
+          {
+            if (!(cqe->flags & IORING_CQE_F_MORE))
+              p->prot.armed = 0;
+            if (cqe->res > 0)
+              {
+                n = p->prot.rq_tail++ & (URING_NBUF - 1);
+                p->prot.rq_bid[n] = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                p->prot.rq_len[n] = cqe->res;
+              }
+            else if (cqe->res == 0)
+              p->prot.eof = 1;
+            else if (cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+              {
+                printf("NetPIPE: io_uring receive failed! errno=%d\n", -cqe->res);
+                exit(401);
+              }
+          }
+        else if (cqe->user_data == UD_SEND)
+          {
+            if (cqe->res < 0)
+              {
+                printf("NetPIPE: io_uring send failed! errno=%d\n", -cqe->res);
+                exit(401);
+              }
+            else if (cqe->res < p->prot.s_left)
+              {
+                p->prot.s_next += cqe->res;
+                p->prot.s_left -= cqe->res;
+                UringSend(p);
+              }
+            else
+              p->prot.sending = 0;
+          }
+        head++;
+      }
+    __atomic_store_n(p->prot.cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Wait until the send in flight is done, its buffer free again */
+static void UringFlush(ArgStruct *p)
+{
+    UringReap(p);
+    while (p->prot.sending)
+      {
+        UringEnter(p, 1);
+        UringReap(p);
+      }
+}
+
+/* Start sending len bytes at q.  The send is submitted by whatever
+ * waits next, so q must stay as it is until then.
+ */
+static void UringWrite(ArgStruct *p, char *q, int len)
+{
+    UringFlush(p);
+    p->prot.s_next = q;
+    p->prot.s_left = len;
+    UringSend(p);
+}
+
+/* Copy len bytes of the received data to q, waiting for more as needed.
+ * Waiting while a send that can't come back short is in flight, wait
+ * for its completion and the data both in one io_uring_enter().
+ * Returns the bytes copied, fewer than len at the end of the stream.
+ */
+static int UringRead(ArgStruct *p, char *q, int len)
+{
+    int got = 0, n, i;
+
+    UringReap(p);
+    while (got < len)
+      {
+        if (p->prot.rq_head != p->prot.rq_tail)
+          {
+            i = p->prot.rq_head & (URING_NBUF - 1);
+            n = MIN(p->prot.rq_len[i] - p->prot.rq_off, len - got);
+            memcpy(q + got, p->prot.bufs + (size_t)p->prot.rq_bid[i] * URING_BUFSZ
+                            + p->prot.rq_off, n);
+            got += n;
+            if ((p->prot.rq_off += n) == p->prot.rq_len[i])
+              {
+                UringRecycle(p, p->prot.rq_bid[i]);
+                p->prot.rq_head++;
+                p->prot.rq_off = 0;
+              }
+            continue;
+          }
+        if (p->prot.eof)
+          break;
+        if (!p->prot.armed)
+          UringArm(p);
+        UringEnter(p, p->prot.sending && !p->prot.s_fixed ? 2 : 1);
+        UringReap(p);
+      }
+
+    /* The data may go where the message in flight is sent from */
+    UringFlush(p);
+    return got;
+}
+
+/* Create the ring for the connection on commfd, register the socket, the
+ * buffers of MyMalloc() and the provided buffer ring with it, and post
+ * the multishot receive.
+ */
+static void UringInit(ArgStruct *p)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg breg;
+    size_t sqsz, cqsz;
+    char *sq, *cq;
+    int i;
+
+    memset(&params, 0, sizeof(params));
+    if (p->prot.sqpoll)
+      {
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 2000;            /* ms before it sleeps */
+      }
+    else
+      params.flags = IORING_SETUP_COOP_TASKRUN;
+    if ((p->prot.ring_fd = UringSetup(URING_ENTRIES, &params)) < 0 &&
+        errno == EINVAL && !p->prot.sqpoll)
+      {
+        params.flags = 0;                        /* Before Linux 5.19 */
+        p->prot.ring_fd = UringSetup(URING_ENTRIES, &params);
+      }
+    if (p->prot.ring_fd < 0)
+      {
+        printf("NetPIPE: io_uring_setup failed! errno=%d\n", errno);
+        exit(-4);
+      }
+
+    sqsz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqsz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      sqsz = cqsz = MAX(sqsz, cqsz);
+    sq = mmap(NULL, sqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+              p->prot.ring_fd, IORING_OFF_SQ_RING);
+    cq = sq;
+    if (sq != MAP_FAILED && !(params.features & IORING_FEAT_SINGLE_MMAP))
+      cq = mmap(NULL, cqsz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                p->prot.ring_fd, IORING_OFF_CQ_RING);
+    p->prot.sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        p->prot.ring_fd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || p->prot.sqes == MAP_FAILED)
+      {
+        printf("NetPIPE: mmap of the io_uring failed! errno=%d\n", errno);
+        exit(-4);
+      }
+    p->prot.sq_ring = sq;
+    p->prot.cq_ring = cq;
+    p->prot.sq_ringsz = sqsz;
+    p->prot.cq_ringsz = cqsz;
+    p->prot.sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    p->prot.sq_head = (unsigned *)(sq + params.sq_off.head);
+    p->prot.sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    p->prot.sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    p->prot.sq_entries = (unsigned *)(sq + params.sq_off.ring_entries);
+    p->prot.sq_flags = (unsigned *)(sq + params.sq_off.flags);
+    p->prot.sq_array = (unsigned *)(sq + params.sq_off.array);
+    p->prot.cq_head = (unsigned *)(cq + params.cq_off.head);
+    p->prot.cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    p->prot.cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    p->prot.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    p->prot.sq_local = *p->prot.sq_tail;
+    p->prot.to_submit = 0;
+
+    if (UringRegister(p, IORING_REGISTER_FILES, &p->commfd, 1) < 0)
+      {
+        printf("NetPIPE: io_uring_register of the socket failed! errno=%d\n", errno);
+        exit(-4);
+      }
+
+    /* Registered buffers are pinned, and may exceed RLIMIT_MEMLOCK on
+     * older kernels, so fall back to sending from user memory.
+     */
+    p->prot.fixed = 0;
+    owner = p;
+    if (nreg > 0)
+      {
+        if (UringRegister(p, IORING_REGISTER_BUFFERS, reg, nreg) == 0)
+          p->prot.fixed = 1;
+        else if (!doing_reset)
+          fprintf(stderr, "NetPIPE: registering buffers with io_uring failed, "
+                          "errno=%d\n", errno);
+      }
+
+    /* The ring of provided buffers must be page aligned */
+    p->prot.br = mmap(NULL, URING_NBUF * sizeof(struct io_uring_buf),
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    p->prot.bufs = malloc((size_t)URING_NBUF * URING_BUFSZ);
+    if (p->prot.br == MAP_FAILED || p->prot.bufs == NULL)
+      {
+        fprintf(stderr, "couldn't allocate memory for io_uring buffers\n");
+        exit(-1);
+      }
+    memset(&breg, 0, sizeof(breg));
+    breg.ring_addr = (unsigned long) p->prot.br;
+    breg.ring_entries = URING_NBUF;
+    breg.bgid = 0;
+    if (UringRegister(p, IORING_REGISTER_PBUF_RING, &breg, 1) < 0)
+      {
+        printf("NetPIPE: io_uring_register of the buffer ring failed! errno=%d\n", errno);
+        exit(-4);
+      }
+    p->prot.br_tail = 0;
+    for (i = 0; i < URING_NBUF; i++)
+      UringRecycle(p, i);
+
+    p->prot.rq_head = p->prot.rq_tail = 0;
+    p->prot.rq_off = 0;
+    p->prot.eof = 0;
+    p->prot.sending = 0;
+    UringArm(p);
+}
+
+/* Finish the send in flight, cancel the multishot receive and take the
+ * ring down, before the socket is closed.
+ */
+static void UringExit(ArgStruct *p)
+{
+    struct io_uring_sqe *sqe;
+
+    if (p->prot.ring_fd < 0)
+      return;
+
+    UringFlush(p);
+    if (p->prot.armed)
+      {
+        sqe = UringSqe(p);
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = UD_RECV;
+        sqe->user_data = UD_CANCEL;
+        UringPush(p);
+        while (p->prot.armed)
+          {
+            UringEnter(p, 1);
+            UringReap(p);
+          }
+      }
+
+    close(p->prot.ring_fd);
+    p->prot.ring_fd = -1;
+    munmap(p->prot.sqes, p->prot.sqes_sz);
+    if (p->prot.cq_ring != p->prot.sq_ring)
+      munmap(p->prot.cq_ring, p->prot.cq_ringsz);
+    munmap(p->prot.sq_ring, p->prot.sq_ringsz);
+    munmap(p->prot.br, URING_NBUF * sizeof(struct io_uring_buf));
+    free(p->prot.bufs);
+    if (owner == p)
+      owner = NULL;
+}
+
+void Setup(ArgStruct *p)
+{
+
+ int one = 1;
+ int sockfd;
+ struct sockaddr_in *lsin1, *lsin2;      /* ptr to sockaddr_in in ArgStruct */
+ char *host;
+ struct hostent *addr;
+ struct protoent *proto;
+ int send_size, recv_size, sizeofint = sizeof(int);
+
+
+ host = p->host;                           /* copy ptr to hostname */
+
+ lsin1 = &(p->prot.sin1);
+ lsin2 = &(p->prot.sin2);
+
+ bzero((char *) lsin1, sizeof(*lsin1));
+ bzero((char *) lsin2, sizeof(*lsin2));
+
+ if ( (sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+   printf("NetPIPE: can't open stream socket! errno=%d\n", errno);
+   exit(-4);
+ }
+
+ if(!(proto = getprotobyname("tcp"))){
+   printf("NetPIPE: protocol 'tcp' unknown!\n");
+   exit(555);
+ }
+
+    /* Attempt to set TCP_NODELAY */
+
+ if(setsockopt(sockfd, proto->p_proto, TCP_NODELAY, &one, sizeof(one)) < 0)
+ {
+   printf("NetPIPE: setsockopt: TCP_NODELAY failed! errno=%d\n", errno);
+   exit(556);
+ }
+
+   /* If requested, set the send and receive buffer sizes */
+
+ if(p->prot.sndbufsz > 0)
+ {
+     if(setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &(p->prot.sndbufsz),
+                                       sizeof(p->prot.sndbufsz)) < 0)
+     {
+          printf("NetPIPE: setsockopt: SO_SNDBUF failed! errno=%d\n", errno);
+          printf("You may have asked for a buffer larger than the system can handle\n");
+          exit(556);
+     }
+     if(setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &(p->prot.rcvbufsz),
+                                       sizeof(p->prot.rcvbufsz)) < 0)
+     {
+          printf("NetPIPE: setsockopt: SO_RCVBUF failed! errno=%d\n", errno);
+          printf("You may have asked for a buffer larger than the system can handle\n");
+          exit(556);
+     }
+ }
+ getsockopt(sockfd, SOL_SOCKET, SO_SNDBUF,
+                 (char *) &send_size, (void *) &sizeofint);
+ getsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+                 (char *) &recv_size, (void *) &sizeofint);
+
+ if(!doing_reset) {
+   fprintf(stderr,"Send and receive buffers are %d and %d bytes\n",
+           send_size, recv_size);
+   fprintf(stderr, "(A bug in Linux doubles the requested buffer sizes)\n");
+   if (p->prot.sqpoll)
+     fprintf(stderr, "Submissions are polled by a kernel thread (SQPOLL)\n");
+ }
+
+ if( p->tr ) {                             /* Primary transmitter */
+
+   if (atoi(host) > 0) {                   /* Numerical IP address */
+     lsin1->sin_family = AF_INET;
+     lsin1->sin_addr.s_addr = inet_addr(host);
+
+   } else {
+
+     if ((addr = gethostbyname(host)) == NULL){
+       printf("NetPIPE: invalid hostname '%s'\n", host);
+       exit(-5);
+     }
+
+     lsin1->sin_family = addr->h_addrtype;
+     bcopy(addr->h_addr, (char*) &(lsin1->sin_addr.s_addr), addr->h_length);
+   }
+
+   lsin1->sin_port = htons(p->port);
+
+   p->commfd = sockfd;
+
+ } else if( p->rcv ) {                     /* we are the receiver */
+
+   bzero((char *) lsin1, sizeof(*lsin1));
+   lsin1->sin_family      = AF_INET;
+   lsin1->sin_addr.s_addr = htonl(INADDR_ANY);
+   lsin1->sin_port        = htons(p->port);
+
+   /* Allow a quick restart while old connections sit in TIME_WAIT */
+   if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(int))) {
+     printf("NetPIPE: server: unable to setsockopt -- errno %d\n", errno);
+     exit(557);
+   }
+
+   if (bind(sockfd, (struct sockaddr *) lsin1, sizeof(*lsin1)) < 0){
+     printf("NetPIPE: server: bind on local address failed! errno=%d", errno);
+     exit(-6);
+   }
+
+   p->servicefd = sockfd;
+ }
+ p->upper = send_size + recv_size;
+
+ establish(p);                               /* Establish connections */
+
+}
+
+void Sync(ArgStruct *p)
+{
+    char s[] = "SyncMe", response[] = "      ";
+
+    UringWrite(p, s, strlen(s));                        /* Write to nbor */
+    if (UringRead(p, response, strlen(s)) != (int)strlen(s)) /* Read from nbor */
+      {
+        fprintf(stderr, "NetPIPE: error writing or reading synchronization string\n");
+        exit(3);
+      }
+    if (strncmp(s, response, strlen(s)))
+      {
+        fprintf(stderr, "NetPIPE: Synchronization string incorrect! |%s|\n", response);
+        exit(3);
+      }
+}
+
+void PrepareToReceive(ArgStruct *p)
+{
+        /*
+            The multishot receive stays posted from connection setup on.
+        */
+}
+
+void SendData(ArgStruct *p)
+{
+    UringWrite(p, p->s_ptr, p->bufflen);
+}
+
+void RecvData(ArgStruct *p)
+{
+    if (UringRead(p, p->r_ptr, p->bufflen) < p->bufflen)
+      {
+        printf("NetPIPE: \"end of file\" encountered on reading from socket\n");
+      }
+}
+
+/* Control messages are sent from prot.ctl, since the send is still in
+ * flight when the caller returns.
+ */
+
+void SendTime(ArgStruct *p, double *t)
+{
+    uint64_t ltime;
+    uint32_t ntime[2];
+
+    /*
+      Send the number of seconds as a 64-bit count of nanoseconds, so
+      long trials do not overflow, high word first in network order.
+      */
+    ltime = (uint64_t)(*t * 1.e9 + 0.5);
+    ntime[0] = htonl((uint32_t)(ltime >> 32));
+    ntime[1] = htonl((uint32_t)ltime);
+
+    UringFlush(p);
+    memcpy(p->prot.ctl, ntime, sizeof(ntime));
+    UringWrite(p, p->prot.ctl, sizeof(ntime));
+}
+
+void RecvTime(ArgStruct *p, double *t)
+{
+    uint64_t ltime;
+    uint32_t ntime[2];
+    int bytesRead;
+
+    bytesRead = UringRead(p, (char *)ntime, sizeof(ntime));
+    if (bytesRead != sizeof(ntime))
+      {
+        fprintf(stderr, "NetPIPE: partial read in RecvTime of %d bytes\n",
+                bytesRead);
+        exit(303);
+      }
+    ltime = ((uint64_t)ntohl(ntime[0]) << 32) | ntohl(ntime[1]);
+
+        /* Result is ltime (in nanoseconds) divided by 1.0e9 to get seconds */
+
+    *t = (double)ltime / 1.0e9;
+}
+
+void SendRepeat(ArgStruct *p, int rpt)
+{
+  uint32_t lrpt, nrpt;
+
+  lrpt = rpt;
+  /* Send repeat count as a long in network order */
+  nrpt = htonl(lrpt);
+  UringFlush(p);
+  memcpy(p->prot.ctl, &nrpt, sizeof(uint32_t));
+  UringWrite(p, p->prot.ctl, sizeof(uint32_t));
+}
+
+void RecvRepeat(ArgStruct *p, int *rpt)
+{
+  uint32_t lrpt, nrpt;
+  int bytesRead;
+
+  bytesRead = UringRead(p, (char *)&nrpt, sizeof(uint32_t));
+  if (bytesRead != sizeof(uint32_t))
+    {
+      fprintf(stderr, "NetPIPE: partial read in RecvRepeat of %d bytes\n",
+              bytesRead);
+      exit(306);
+    }
+  lrpt = ntohl(nrpt);
+
+  *rpt = lrpt;
+}
+
+void establish(ArgStruct *p)
+{
+  int one = 1;
+  socklen_t clen;
+  struct protoent *proto;
+
+  clen = (socklen_t) sizeof(p->prot.sin2);
+
+  if( p->tr ){
+
+    while( connect(p->commfd, (struct sockaddr *) &(p->prot.sin1),
+                   sizeof(p->prot.sin1)) < 0 ) {
+
+      /* If we are doing a reset and we get a connection refused from
+       * the connect() call, assume that the other node has not yet
+       * gotten to its corresponding accept() call and keep trying until
+       * we have success.
+       */
+      if(!doing_reset || errno != ECONNREFUSED) {
+        printf("Client: Cannot Connect! errno=%d\n",errno);
+        exit(-10);
+      }
+
+    }
+
+  } else if( p->rcv ) {
+
+    /* SERVER */
+    listen(p->servicefd, 5);
+    p->commfd = accept(p->servicefd, (struct sockaddr *) &(p->prot.sin2), &clen);
+
+    if(p->commfd < 0){
+      printf("Server: Accept Failed! errno=%d\n",errno);
+      exit(-12);
+    }
+
+    /*
+      Attempt to set TCP_NODELAY. TCP_NODELAY may or may not be propagated
+      to accepted sockets.
+     */
+    if(!(proto = getprotobyname("tcp"))){
+      printf("unknown protocol!\n");
+      exit(555);
+    }
+
+    if(setsockopt(p->commfd, proto->p_proto, TCP_NODELAY,
+                  &one, sizeof(one)) < 0)
+    {
+      printf("setsockopt: TCP_NODELAY failed! errno=%d\n", errno);
+      exit(556);
+    }
+
+    if (setsockopt(p->commfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(int))) {
+      printf("NetPIPE: server: unable to setsockopt -- errno %d\n", errno);
+      exit(557);
+    }
+
+    /* If requested, set the send and receive buffer sizes */
+    if(p->prot.sndbufsz > 0)
+    {
+      if(setsockopt(p->commfd, SOL_SOCKET, SO_SNDBUF, &(p->prot.sndbufsz),
+                                       sizeof(p->prot.sndbufsz)) < 0)
+      {
+        printf("setsockopt: SO_SNDBUF failed! errno=%d\n", errno);
+        exit(556);
+      }
+      if(setsockopt(p->commfd, SOL_SOCKET, SO_RCVBUF, &(p->prot.rcvbufsz),
+                                       sizeof(p->prot.rcvbufsz)) < 0)
+      {
+        printf("setsockopt: SO_RCVBUF failed! errno=%d\n", errno);
+        exit(556);
+      }
+    }
+  }
+
+  UringInit(p);
+}
+
+void CleanUp(ArgStruct *p)
+{
+   char quit[5] = "QUIT";
+
+   if (p->tr) {
+
+      UringWrite(p, quit, 5);
+      UringRead(p, quit, 5);
+      UringExit(p);
+      close(p->commfd);
+
+   } else if( p->rcv ) {
+
+      UringRead(p, quit, 5);
+      UringWrite(p, quit, 5);
+      UringExit(p);
+      close(p->commfd);
+      close(p->servicefd);
+
+   }
+}
+
+
+void Reset(ArgStruct *p)
+{
+
+  /* Reset sockets */
+
+  if(p->reset_conn) {
+
+    doing_reset = 1;
+
+    if (p->tr) {
+
+      /* Close the socket */
+
+      CleanUp(p);
+
+      /* Now open and connect a new socket */
+
+      Setup(p);
+
+    } else if (p->rcv) {
+
+      char quit[5];
+
+      /* Keep the listening socket open so the transmitter can never
+       * connect to a listener that is about to be closed, and just
+       * accept the next connection on it.
+       */
+
+      UringRead(p, quit, 5);
+      UringWrite(p, quit, 5);
+      UringExit(p);
+      close(p->commfd);
+
+      establish(p);
+
+    }
+
+  }
+
+}
+
+void AfterAlignmentInit(ArgStruct *p)
+{
+
+}
+
+/* Allocate the buffers as netpipe.c does, and register them with the
+ * ring so sends need not map the pages of each message.
+ */
+void MyMalloc(ArgStruct *p, int bufflen, int soffset, int roffset)
+{
+    if((p->r_buff=(char *)malloc(bufflen+MAX(soffset,roffset)))==(char *)NULL)
+    {
+        fprintf(stderr,"couldn't allocate memory for receive buffer\n");
+        exit(-1);
+    }
+    reg[0].iov_base = p->r_buff;
+    reg[0].iov_len = bufflen+MAX(soffset,roffset);
+    nreg = 1;
+       /* if pcache==1, use cache, so this line happens only if flushing cache */
+
+    if(!p->cache) /* Allocate second buffer if limiting cache */
+    {
+      if((p->s_buff=(char *)malloc(bufflen+soffset))==(char *)NULL)
+      {
+          fprintf(stderr,"couldn't allocate memory for send buffer\n");
+          exit(-1);
+      }
+      reg[1].iov_base = p->s_buff;
+      reg[1].iov_len = bufflen+soffset;
+      nreg = 2;
+    }
+
+    if (owner != NULL)
+    {
+      UringFlush(owner);
+      if (owner->prot.fixed)
+        UringRegister(owner, IORING_UNREGISTER_BUFFERS, NULL, 0);
+      owner->prot.fixed =
+        UringRegister(owner, IORING_REGISTER_BUFFERS, reg, nreg) == 0;
+    }
+}
+
+void FreeBuff(char *buff1, char *buff2)
+{
+  /* Nothing may be sent from the buffers once they are freed */
+  if (owner != NULL)
+  {
+    UringFlush(owner);
+    if (owner->prot.fixed)
+      UringRegister(owner, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    owner->prot.fixed = 0;
+  }
+  nreg = 0;
+
+  if(buff1 != NULL)
+
+   free(buff1);
+
+
+  if(buff2 != NULL)
+
+   free(buff2);
+}